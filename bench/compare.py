@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+"""Compare two result directories written by run_suite.sh.
+
+    bench/compare.py bench/results/<old> bench/results/<new> [--threshold 5]
+
+Prints every metric found in both runs with its relative change and exits
+non-zero if any throughput metric dropped, or any latency metric rose, by
+more than the threshold (percent).
+"""
+
+import argparse
+import json
+import os
+import sys
+
+# Metrics where a larger value is worse
+LATENCY_KEYS = ("_ns", "ns_per_op")
+# Fields that identify a result row rather than measure it
+PARAM_KEYS = ("bench", "op", "msg_size", "size", "threads", "total_bytes", "readers")
+
+
+def harness_metrics(doc):
+    """Flatten a drvbench/dyn_append/ioctl_resize document into {name: value}."""
+    out = {}
+    rows = doc.get("results") or doc.get("points") or [doc]
+    for row in rows:
+        params = ",".join(f"{k}={v}" for k, v in row.items() if k in PARAM_KEYS)
+        for key, value in row.items():
+            if isinstance(value, (int, float)) and not isinstance(value, bool) and \
+                    key not in PARAM_KEYS + ("iters", "bytes"):
+                out[f"{params}:{key}" if params else key] = float(value)
+    return out
+
+
+def fio_metrics(doc):
+    out = {}
+    for job in doc.get("jobs", []):
+        for direction in ("read", "write"):
+            stats = job.get(direction, {})
+            if stats.get("io_bytes"):
+                out[f"{job['jobname']}:iops"] = float(stats["iops"])
+                clat = stats.get("clat_ns", {}).get("percentile", {})
+                if "99.000000" in clat:
+                    out[f"{job['jobname']}:p99_clat_ns"] = float(clat["99.000000"])
+    return out
+
+
+def load(directory):
+    metrics = {}
+    for name in sorted(os.listdir(directory)):
+        if not name.endswith(".json"):
+            continue
+        with open(os.path.join(directory, name)) as f:
+            doc = json.load(f)
+        flat = fio_metrics(doc) if "jobs" in doc else harness_metrics(doc)
+        for key, value in flat.items():
+            metrics[f"{name[:-5]}/{key}"] = value
+    return metrics
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("old")
+    parser.add_argument("new")
+    parser.add_argument("--threshold", type=float, default=5.0)
+    args = parser.parse_args()
+
+    old, new = load(args.old), load(args.new)
+    regressions = 0
+    for key in sorted(old.keys() & new.keys()):
+        before, after = old[key], new[key]
+        change = (after - before) / before * 100 if before else 0.0
+        if key.endswith(("errors", "mismatches")):
+            worse = after > before
+        elif key.rsplit(":", 1)[-1].endswith(LATENCY_KEYS):
+            worse = change > args.threshold
+        else:
+            worse = change < -args.threshold
+        regressions += worse
+        print(f"{'REGRESSION ' if worse else '           '}{key}: {before:.6g} -> {after:.6g} ({change:+.1f}%)")
+
+    print(f"{regressions} regression(s) beyond {args.threshold}%")
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,310 @@
+// Userspace benchmark harness for the character drivers in this repo.
+//
+//   drvbench pipe-throughput [--dev /dev/char_pipe_dev] [--sizes 1,64,4096]
+//                            [--threads 1,2,4] [--bytes 4194304]
+//   drvbench pipe-pingpong   [--dev /dev/char_pipe_dev] [--sizes 1,64,4096]
+//                            [--iters 10000]
+//   drvbench chardev         --dev /dev/char_simp_dev [--sizes 64,255]
+//                            [--threads 1,2,4] [--seconds 2]
+//
+// Every subcommand prints a single JSON object on stdout.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double seconds_since(Clock::time_point t0) {
+    return std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+std::vector<size_t> parse_list(const std::string &s) {
+    std::vector<size_t> out;
+    size_t start = 0;
+
+    while (start < s.size()) {
+        size_t end = s.find(',', start);
+        if (end == std::string::npos) {
+            end = s.size();
+        }
+        out.push_back(strtoull(s.substr(start, end - start).c_str(), nullptr, 0));
+        start = end + 1;
+    }
+    return out;
+}
+
+struct Options {
+    std::map<std::string, std::string> values;
+
+    std::string get(const std::string &key, const std::string &def) const {
+        auto it = values.find(key);
+        return it == values.end() ? def : it->second;
+    }
+};
+
+int open_or_die(const std::string &dev, int flags) {
+    int fd = open(dev.c_str(), flags);
+    if (fd < 0) {
+        perror(dev.c_str());
+        exit(1);
+    }
+    return fd;
+}
+
+// Read or write exactly len bytes, tolerating short transfers
+bool xfer_all(int fd, char *buf, size_t len, bool is_write) {
+    while (len > 0) {
+        ssize_t n = is_write ? write(fd, buf, len) : read(fd, buf, len);
+        if (n <= 0) {
+            return false;
+        }
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+// N writer threads and N reader threads share the pipe. Each side moves a
+// fixed quota so every thread finishes without leaving data in the ring.
+int pipe_throughput(const Options &opt) {
+    std::string dev = opt.get("dev", "/dev/char_pipe_dev");
+    auto sizes = parse_list(opt.get("sizes", "1,64,4096"));
+    auto threads = parse_list(opt.get("threads", "1,2,4"));
+    size_t bytes = strtoull(opt.get("bytes", "4194304").c_str(), nullptr, 0);
+
+    printf("{\"bench\": \"pipe_throughput\", \"device\": \"%s\", \"results\": [", dev.c_str());
+    bool first = true;
+    for (size_t msg : sizes) {
+        for (size_t nthreads : threads) {
+            if (msg == 0 || nthreads == 0) {
+                continue;
+            }
+            size_t per_thread = std::max<size_t>(bytes / nthreads / msg, 1) * msg;
+            std::atomic<bool> failed{false};
+            std::vector<std::thread> workers;
+            auto t0 = Clock::now();
+
+            for (size_t t = 0; t < nthreads; t++) {
+                for (bool is_write : {true, false}) {
+                    workers.emplace_back([&, is_write] {
+                        int fd = open_or_die(dev, is_write ? O_WRONLY : O_RDONLY);
+                        std::vector<char> buf(msg, 'p');
+                        for (size_t done = 0; done < per_thread; done += msg) {
+                            if (!xfer_all(fd, buf.data(), msg, is_write)) {
+                                failed = true;
+                                break;
+                            }
+                        }
+                        close(fd);
+                    });
+                }
+            }
+            for (auto &w : workers) {
+                w.join();
+            }
+
+            double elapsed = seconds_since(t0);
+            double total = (double)per_thread * nthreads;
+            printf("%s{\"msg_size\": %zu, \"threads\": %zu, \"bytes\": %.0f, \"mb_per_s\": %.2f, "
+                   "\"msgs_per_s\": %.0f, \"ok\": %s}",
+                   first ? "" : ", ", msg, nthreads, total, total / elapsed / 1e6,
+                   total / msg / elapsed, failed ? "false" : "true");
+            first = false;
+        }
+    }
+    printf("]}\n");
+    return 0;
+}
+
+// Spin until counter has passed i, yielding now and then so a single-CPU guest
+// still makes progress. Returns false if the other side gave up.
+bool wait_past(const std::atomic<size_t> &counter, size_t i, const std::atomic<bool> &failed) {
+    for (unsigned spins = 1; counter.load(std::memory_order_acquire) <= i; spins++) {
+        if (failed.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        if (spins % 1024 == 0) {
+            std::this_thread::yield();
+        }
+    }
+    return true;
+}
+
+// Round trip through the single pipe: A writes, B reads and replies, A reads
+// the reply. Both ends share one ring, so each side must not read until the
+// other has consumed what it wrote:
+//   - replied keeps A from reading back its own request;
+//   - consumed keeps B from reading back its own reply.
+// A's wait on replied overlaps B's read, which is part of the round trip
+// anyway; the flags themselves add one cache-line transfer each. Requests
+// are 'q' and replies 'r', and any crossed message fails the run.
+int pipe_pingpong(const Options &opt) {
+    std::string dev = opt.get("dev", "/dev/char_pipe_dev");
+    auto sizes = parse_list(opt.get("sizes", "1,64,4096"));
+    size_t iters = strtoull(opt.get("iters", "10000").c_str(), nullptr, 0);
+
+    printf("{\"bench\": \"pipe_pingpong\", \"device\": \"%s\", \"results\": [", dev.c_str());
+    bool first = true;
+    for (size_t msg : sizes) {
+        if (msg == 0 || iters == 0) {
+            continue;
+        }
+        std::atomic<size_t> replied{0};
+        std::atomic<size_t> consumed{0};
+        std::atomic<bool> failed{false};
+        std::vector<double> rtt_ns(iters);
+
+        std::thread responder([&] {
+            int fd = open_or_die(dev, O_RDWR);
+            std::vector<char> buf(msg);
+            for (size_t i = 0; i < iters && !failed; i++) {
+                if (!xfer_all(fd, buf.data(), msg, false) ||
+                    std::any_of(buf.begin(), buf.end(), [](char c) { return c != 'q'; })) {
+                    failed = true;
+                    break;
+                }
+                replied.store(i + 1, std::memory_order_release);
+                std::fill(buf.begin(), buf.end(), 'r');
+                if (!xfer_all(fd, buf.data(), msg, true) || !wait_past(consumed, i, failed)) {
+                    failed = true;
+                    break;
+                }
+            }
+            close(fd);
+        });
+
+        int fd = open_or_die(dev, O_RDWR);
+        std::vector<char> buf(msg);
+        for (size_t i = 0; i < iters && !failed; i++) {
+            std::fill(buf.begin(), buf.end(), 'q');
+            auto t0 = Clock::now();
+            if (!xfer_all(fd, buf.data(), msg, true) || !wait_past(replied, i, failed) ||
+                !xfer_all(fd, buf.data(), msg, false)) {
+                failed = true;
+                break;
+            }
+            rtt_ns[i] = seconds_since(t0) * 1e9;
+            consumed.store(i + 1, std::memory_order_release);
+            if (std::any_of(buf.begin(), buf.end(), [](char c) { return c != 'r'; })) {
+                failed = true;
+                break;
+            }
+        }
+        close(fd);
+        responder.join();
+
+        std::sort(rtt_ns.begin(), rtt_ns.end());
+        auto pct = [&](double p) { return rtt_ns[std::min(iters - 1, (size_t)(p * iters))]; };
+        printf("%s{\"msg_size\": %zu, \"iters\": %zu, \"p50_ns\": %.0f, \"p99_ns\": %.0f, "
+               "\"max_ns\": %.0f, \"ok\": %s}",
+               first ? "" : ", ", msg, iters, pct(0.50), pct(0.99), rtt_ns.back(),
+               failed ? "false" : "true");
+        first = false;
+    }
+    printf("]}\n");
+    return 0;
+}
+
+// Positional write then read throughput at offset 0, one fd per thread
+int chardev(const Options &opt) {
+    std::string dev = opt.get("dev", "");
+    auto sizes = parse_list(opt.get("sizes", "64,255"));
+    auto threads = parse_list(opt.get("threads", "1,2,4"));
+    double duration = atof(opt.get("seconds", "2").c_str());
+
+    if (dev.empty()) {
+        fprintf(stderr, "chardev: --dev is required\n");
+        return 2;
+    }
+
+    printf("{\"bench\": \"chardev_rw\", \"device\": \"%s\", \"results\": [", dev.c_str());
+    bool first = true;
+    for (size_t msg : sizes) {
+        for (size_t nthreads : threads) {
+            for (bool is_write : {true, false}) {
+                if (msg == 0 || nthreads == 0) {
+                    continue;
+                }
+                std::atomic<uint64_t> ops{0}, bytes{0}, errors{0};
+                std::vector<std::thread> workers;
+                auto t0 = Clock::now();
+
+                for (size_t t = 0; t < nthreads; t++) {
+                    workers.emplace_back([&, is_write] {
+                        int fd = open_or_die(dev, O_RDWR);
+                        std::vector<char> buf(msg, 'c');
+                        uint64_t my_ops = 0, my_bytes = 0, my_errors = 0;
+                        while (seconds_since(t0) < duration) {
+                            ssize_t n = is_write ? pwrite(fd, buf.data(), msg, 0) : pread(fd, buf.data(), msg, 0);
+                            if (n < 0) {
+                                my_errors++;
+                                continue;
+                            }
+                            my_ops++;
+                            my_bytes += n;
+                        }
+                        close(fd);
+                        ops += my_ops;
+                        bytes += my_bytes;
+                        errors += my_errors;
+                    });
+                }
+                for (auto &w : workers) {
+                    w.join();
+                }
+
+                double elapsed = seconds_since(t0);
+                printf("%s{\"op\": \"%s\", \"msg_size\": %zu, \"threads\": %zu, \"ops_per_s\": %.0f, "
+                       "\"mb_per_s\": %.2f, \"errors\": %llu}",
+                       first ? "" : ", ", is_write ? "write" : "read", msg, nthreads, ops / elapsed,
+                       bytes / elapsed / 1e6, (unsigned long long)errors.load());
+                first = false;
+            }
+        }
+    }
+    printf("]}\n");
+    return 0;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s pipe-throughput|pipe-pingpong|chardev [--key value]...\n", argv[0]);
+        return 2;
+    }
+
+    Options opt;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        if (strncmp(argv[i], "--", 2)) {
+            fprintf(stderr, "unexpected argument %s\n", argv[i]);
+            return 2;
+        }
+        opt.values[argv[i] + 2] = argv[i + 1];
+    }
+
+    std::string cmd = argv[1];
+    if (cmd == "pipe-throughput") {
+        return pipe_throughput(opt);
+    } else if (cmd == "pipe-pingpong") {
+        return pipe_pingpong(opt);
+    } else if (cmd == "chardev") {
+        return chardev(opt);
+    }
+    fprintf(stderr, "unknown benchmark %s\n", cmd.c_str());
+    return 2;
+}
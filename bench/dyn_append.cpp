@@ -0,0 +1,95 @@
+// Append throughput of char_dyn_dev as a function of the device size.
+//
+// Appends fixed-size records until the device holds --max bytes and reports
+// the throughput of each doubling interval as JSON. With amortized growth the
+// curve should stay flat; a realloc-per-write backing falls off linearly.
+//
+//   ./dyn_append [--dev /dev/char_dyn_dev] [--record 4096] [--max 67108864]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+struct Point {
+    size_t total_bytes;
+    double mb_per_s;
+};
+
+double now_seconds() {
+    using clock = std::chrono::steady_clock;
+    return std::chrono::duration<double>(clock::now().time_since_epoch()).count();
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    std::string dev = "/dev/char_dyn_dev";
+    size_t record = 4096;
+    size_t max_bytes = 64UL << 20;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "--dev")) {
+            dev = argv[i + 1];
+        } else if (!strcmp(argv[i], "--record")) {
+            record = strtoull(argv[i + 1], nullptr, 0);
+        } else if (!strcmp(argv[i], "--max")) {
+            max_bytes = strtoull(argv[i + 1], nullptr, 0);
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+    if (record == 0 || max_bytes < record) {
+        fprintf(stderr, "invalid --record/--max\n");
+        return 2;
+    }
+
+    int fd = open(dev.c_str(), O_WRONLY | O_TRUNC | O_APPEND);
+    if (fd < 0) {
+        perror(dev.c_str());
+        return 1;
+    }
+
+    std::vector<char> buf(record, 'x');
+    std::vector<Point> points;
+    size_t total = 0;
+    size_t next_mark = record;
+    size_t interval_bytes = 0;
+    double interval_start = now_seconds();
+
+    while (total < max_bytes) {
+        ssize_t n = write(fd, buf.data(), buf.size());
+        if (n <= 0) {
+            perror("write");
+            break;
+        }
+        total += n;
+        interval_bytes += n;
+
+        if (total >= next_mark) {
+            double elapsed = now_seconds() - interval_start;
+            points.push_back({total, elapsed > 0 ? interval_bytes / elapsed / 1e6 : 0});
+            next_mark *= 2;
+            interval_bytes = 0;
+            interval_start = now_seconds();
+        }
+    }
+    close(fd);
+
+    printf("{\"bench\": \"char_dyn_append\", \"device\": \"%s\", \"record_size\": %zu, \"points\": [",
+           dev.c_str(), record);
+    for (size_t i = 0; i < points.size(); i++) {
+        printf("%s{\"total_bytes\": %zu, \"mb_per_s\": %.2f}", i ? ", " : "",
+               points[i].total_bytes, points[i].mb_per_s);
+    }
+    printf("]}\n");
+    return 0;
+}
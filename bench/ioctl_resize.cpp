@@ -0,0 +1,162 @@
+// Read latency of ioctl_char_dev while the buffer is being resized.
+//
+// Reader threads pread() the device in a loop while one thread keeps
+// resizing it with IOCTL_CHAR_RESIZE. Reads should never stall behind a
+// resize, so the max read latency should stay close to the idle case.
+// Every read is also checked: resizes never shrink below the filled prefix,
+// so a read must return exactly that prefix, all 'r'. Anything else (a torn
+// read, stale or freed memory, a wrong length) counts as a mismatch.
+//
+//   ./ioctl_resize [--dev /dev/ioctl_char_dev] [--readers 4] [--seconds 5]
+//                  [--min-size 4096] [--max-size 1048576]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "ioctl_char/ioctl_char.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct ReaderStats {
+    uint64_t reads = 0;
+    uint64_t errors = 0;
+    uint64_t mismatches = 0;
+    uint64_t max_ns = 0;
+    uint64_t total_ns = 0;
+};
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    std::string dev = "/dev/ioctl_char_dev";
+    int readers = 4;
+    int seconds = 5;
+    uint64_t min_size = 4096;
+    uint64_t max_size = 1 << 20;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "--dev")) {
+            dev = argv[i + 1];
+        } else if (!strcmp(argv[i], "--readers")) {
+            readers = atoi(argv[i + 1]);
+        } else if (!strcmp(argv[i], "--seconds")) {
+            seconds = atoi(argv[i + 1]);
+        } else if (!strcmp(argv[i], "--min-size")) {
+            min_size = strtoull(argv[i + 1], nullptr, 0);
+        } else if (!strcmp(argv[i], "--max-size")) {
+            max_size = strtoull(argv[i + 1], nullptr, 0);
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+    if (readers <= 0 || seconds <= 0 || min_size == 0 || max_size < min_size) {
+        fprintf(stderr, "invalid arguments\n");
+        return 2;
+    }
+
+    int ctl = open(dev.c_str(), O_RDWR);
+    if (ctl < 0) {
+        perror(dev.c_str());
+        return 1;
+    }
+    __u32 version = 0;
+    if (ioctl(ctl, IOCTL_CHAR_GET_VERSION, &version) || version != IOCTL_CHAR_ABI_VERSION) {
+        fprintf(stderr, "%s: unsupported ABI version %u\n", dev.c_str(), version);
+        return 1;
+    }
+
+    // Give the readers something to copy, sized so the whole prefix fits
+    uint64_t start_size = min_size;
+    if (ioctl(ctl, IOCTL_CHAR_RESIZE, &start_size)) {
+        perror("IOCTL_CHAR_RESIZE");
+        return 1;
+    }
+    std::vector<char> fill(min_size, 'r');
+    ssize_t filled = write(ctl, fill.data(), fill.size());
+    if (filled <= 0) {
+        perror("write");
+        return 1;
+    }
+
+    std::atomic<bool> stop{false};
+    std::vector<ReaderStats> stats(readers);
+    std::vector<std::thread> threads;
+
+    for (int r = 0; r < readers; r++) {
+        threads.emplace_back([&, r] {
+            int fd = open(dev.c_str(), O_RDONLY);
+            std::vector<char> buf(max_size);
+            ReaderStats &st = stats[r];
+
+            if (fd < 0) {
+                st.errors++;
+                return;
+            }
+            while (!stop.load(std::memory_order_relaxed)) {
+                auto t0 = Clock::now();
+                ssize_t n = pread(fd, buf.data(), buf.size(), 0);
+                uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t0).count();
+
+                if (n < 0) {
+                    st.errors++;
+                } else if (n != filled || (uint64_t)n > max_size ||
+                           std::any_of(buf.begin(), buf.begin() + n, [](char c) { return c != 'r'; })) {
+                    st.mismatches++;
+                }
+                st.reads++;
+                st.total_ns += ns;
+                st.max_ns = std::max(st.max_ns, ns);
+            }
+            close(fd);
+        });
+    }
+
+    uint64_t resizes = 0, resize_errors = 0;
+    auto deadline = Clock::now() + std::chrono::seconds(seconds);
+    uint64_t new_size = min_size;
+    while (Clock::now() < deadline) {
+        new_size = new_size * 2 > max_size ? min_size : new_size * 2;
+        if (ioctl(ctl, IOCTL_CHAR_RESIZE, &new_size)) {
+            resize_errors++;
+        }
+        resizes++;
+    }
+    stop = true;
+    for (auto &t : threads) {
+        t.join();
+    }
+    close(ctl);
+
+    ReaderStats sum;
+    for (const auto &st : stats) {
+        sum.reads += st.reads;
+        sum.errors += st.errors;
+        sum.mismatches += st.mismatches;
+        sum.total_ns += st.total_ns;
+        sum.max_ns = std::max(sum.max_ns, st.max_ns);
+    }
+
+    printf("{\"bench\": \"ioctl_char_read_during_resize\", \"device\": \"%s\", \"readers\": %d, "
+           "\"seconds\": %d, \"resizes\": %llu, \"resize_errors\": %llu, \"reads\": %llu, "
+           "\"read_errors\": %llu, \"read_mismatches\": %llu, \"reads_per_s\": %.0f, \"avg_read_ns\": %.0f, \"max_read_ns\": %llu}\n",
+           dev.c_str(), readers, seconds, (unsigned long long)resizes, (unsigned long long)resize_errors,
+           (unsigned long long)sum.reads, (unsigned long long)sum.errors,
+           (unsigned long long)sum.mismatches, (double)sum.reads / seconds,
+           sum.reads ? (double)sum.total_ns / sum.reads : 0.0, (unsigned long long)sum.max_ns);
+    return sum.errors || sum.mismatches || resize_errors ? 1 : 0;
+}
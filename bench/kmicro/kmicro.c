@@ -0,0 +1,187 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/uio.h>
+#include <linux/moduleparam.h>
+
+#include "../../pipe/circ_buf.h"
+#include "../../pipe/bcast_buf.h"
+#include "../../simple_block/srd_store.h"
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("BiscuitBobby");
+MODULE_DESCRIPTION("In-kernel microbenchmarks for the pipe ring buffers and ramdisk I/O core");
+
+// Runs every benchmark at load time and logs one JSON line per result:
+//   insmod kmicro.ko iters=100000 && dmesg | grep kmicro: && rmmod kmicro
+static int iters = 100000;
+module_param(iters, int, 0444);
+MODULE_PARM_DESC(iters, "Iterations per benchmark (default: 100000)");
+
+#define SRD_BENCH_SIZE (16UL << 20)
+#define BCAST_MAX_READERS 16
+
+static void report(const char *name, size_t size, u64 elapsed_ns) {
+    pr_info("kmicro: {\"bench\": \"%s\", \"size\": %zu, \"iters\": %d, \"ns_per_op\": %llu}\n",
+            name, size, iters, div_u64(elapsed_ns, iters));
+}
+
+// Unlocked put/get pairs: the cost of the ring copies alone
+static void bench_ring_copy(circular_buffer_t *cb, char *buf, size_t size) {
+    struct kvec kv = { .iov_base = buf, .iov_len = size };
+    struct iov_iter iter;
+    u64 start = ktime_get_ns();
+
+    for (int i = 0; i < iters; i++) {
+        iov_iter_kvec(&iter, ITER_SOURCE, &kv, 1, size);
+        circular_buffer_put(cb, &iter);
+        iov_iter_kvec(&iter, ITER_DEST, &kv, 1, size);
+        circular_buffer_get(cb, &iter);
+    }
+    report("ring_put_get", size, ktime_get_ns() - start);
+}
+
+// The full driver path: lock, copy, unlock and wake the other side
+static void bench_ring_locked(circular_buffer_t *cb, char *buf, size_t size) {
+    struct kvec kv = { .iov_base = buf, .iov_len = size };
+    struct iov_iter iter;
+    u64 start = ktime_get_ns();
+
+    for (int i = 0; i < iters; i++) {
+        iov_iter_kvec(&iter, ITER_SOURCE, &kv, 1, size);
+        circular_buffer_write(cb, &iter, NULL);
+        iov_iter_kvec(&iter, ITER_DEST, &kv, 1, size);
+        circular_buffer_read(cb, &iter, NULL);
+    }
+    report("ring_write_read", size, ktime_get_ns() - start);
+}
+
+static void bench_mutex(circular_buffer_t *cb) {
+    u64 start = ktime_get_ns();
+
+    for (int i = 0; i < iters; i++) {
+        mutex_lock(&cb->lock);
+        mutex_unlock(&cb->lock);
+    }
+    report("ring_mutex_uncontended", 0, ktime_get_ns() - start);
+}
+
+// One broadcast put consumed by every reader: the writer side should stay
+// flat as readers are added, the total grows by one copy per reader
+static void bench_bcast(broadcast_buffer_t *bb, struct bcast_reader *readers, int nr_readers,
+                        const char *name, char *buf, size_t size) {
+    struct kvec kv = { .iov_base = buf, .iov_len = size };
+    struct iov_iter iter;
+    u64 start;
+
+    broadcast_buffer_init(bb, BCAST_BLOCK);
+    for (int r = 0; r < nr_readers; r++) {
+        broadcast_buffer_add_reader(bb, &readers[r]);
+    }
+
+    start = ktime_get_ns();
+    for (int i = 0; i < iters; i++) {
+        iov_iter_kvec(&iter, ITER_SOURCE, &kv, 1, size);
+        broadcast_buffer_put(bb, &iter);
+        for (int r = 0; r < nr_readers; r++) {
+            iov_iter_kvec(&iter, ITER_DEST, &kv, 1, size);
+            broadcast_buffer_get(bb, &readers[r], &iter);
+        }
+    }
+    report(name, size, ktime_get_ns() - start);
+}
+
+static void bench_srd(struct simple_ramdisk *dev, const char *name, enum req_op op,
+                      char *buf, size_t size, size_t stride) {
+    size_t offset = 0;
+    u64 start = ktime_get_ns();
+
+    for (int i = 0; i < iters; i++) {
+        srd_do_io(dev, op, buf, offset, size);
+        offset += stride;
+        if (offset + size > dev->size) {
+            offset = 0;
+        }
+    }
+    report(name, size, ktime_get_ns() - start);
+}
+
+// Allocate a backing page on write and give it back on discard
+static void bench_srd_alloc(struct simple_ramdisk *dev, char *buf) {
+    u64 start = ktime_get_ns();
+
+    for (int i = 0; i < iters; i++) {
+        srd_do_io(dev, REQ_OP_WRITE, buf, 0, PAGE_SIZE);
+        srd_do_io(dev, REQ_OP_DISCARD, NULL, 0, PAGE_SIZE);
+    }
+    report("srd_write_discard", PAGE_SIZE, ktime_get_ns() - start);
+}
+
+static int __init kmicro_init(void) {
+    static const size_t ring_sizes[] = { 1, 64, 512, 4096 };
+    static const int bcast_readers[] = { 1, 4, BCAST_MAX_READERS };
+    static const char *const bcast_names[] = { "bcast_1_reader", "bcast_4_readers", "bcast_16_readers" };
+    struct bcast_reader *readers;
+    struct simple_ramdisk *dev;
+    broadcast_buffer_t *bb;
+    circular_buffer_t *cb;
+    char *buf, *rbuf;
+
+    if (iters <= 0) {
+        return -EINVAL;
+    }
+
+    cb = kmalloc(sizeof(*cb), GFP_KERNEL);
+    bb = kmalloc(sizeof(*bb), GFP_KERNEL);
+    readers = kcalloc(BCAST_MAX_READERS, sizeof(*readers), GFP_KERNEL);
+    dev = kzalloc(sizeof(*dev), GFP_KERNEL);
+    buf = kmalloc(PAGE_SIZE, GFP_KERNEL);
+    rbuf = kmalloc(PAGE_SIZE, GFP_KERNEL);
+    if (!cb || !bb || !readers || !dev || !buf || !rbuf) {
+        kfree(cb);
+        kfree(bb);
+        kfree(readers);
+        kfree(dev);
+        kfree(buf);
+        kfree(rbuf);
+        return -ENOMEM;
+    }
+    // Writes always come from buf: reading a hole zeroes its destination, and
+    // srd_write_chunk() skips all-zero data without allocating
+    memset(buf, 0xa5, PAGE_SIZE);
+
+    circular_buffer_init(cb);
+    for (int i = 0; i < ARRAY_SIZE(ring_sizes); i++) {
+        bench_ring_copy(cb, buf, ring_sizes[i]);
+        bench_ring_locked(cb, buf, ring_sizes[i]);
+    }
+    bench_mutex(cb);
+
+    for (int i = 0; i < ARRAY_SIZE(bcast_readers); i++) {
+        bench_bcast(bb, readers, bcast_readers[i], bcast_names[i], buf, 512);
+    }
+
+    srd_init_store(dev, SRD_BENCH_SIZE, true);
+    bench_srd(dev, "srd_read_hole", REQ_OP_READ, rbuf, PAGE_SIZE, PAGE_SIZE);
+    bench_srd_alloc(dev, buf);
+    bench_srd(dev, "srd_write", REQ_OP_WRITE, buf, PAGE_SIZE, PAGE_SIZE);
+    bench_srd(dev, "srd_read", REQ_OP_READ, rbuf, PAGE_SIZE, PAGE_SIZE);
+    // Sector-aligned but page-straddling, so every op touches two backing pages
+    bench_srd(dev, "srd_write_straddle", REQ_OP_WRITE, buf, 1024, PAGE_SIZE + 3584);
+    srd_free_pages(dev);
+
+    kfree(rbuf);
+    kfree(buf);
+    kfree(dev);
+    kfree(readers);
+    kfree(bb);
+    kfree(cb);
+    return 0;
+}
+
+static void __exit kmicro_exit(void) {
+}
+
+module_init(kmicro_init);
+module_exit(kmicro_exit);
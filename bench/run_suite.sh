@@ -0,0 +1,71 @@
+#!/bin/sh
+# Load each driver in turn, run its benchmarks and write one JSON file per
+# benchmark to OUT (default: bench/results/<short commit>). Run as root on
+# the machine under test, normally inside the guest started by run_vm.sh.
+# The modules and bench/ must already be built.
+set -eu
+
+REPO=$(cd "$(dirname "$0")/.." && pwd)
+BENCH=$REPO/bench
+OUT=${1:-$BENCH/results/$(git -C "$REPO" rev-parse --short HEAD 2>/dev/null || echo local)}
+QUEUE_DEPTHS=${QUEUE_DEPTHS:-"1 4 16 32"}
+SPILL_FILE=${SPILL_FILE:-/tmp/char_pipe.spill} # Any local tmpfs or ext4 path
+
+mkdir -p "$OUT"
+
+# The char drivers only register a chrdev region, so create their node by hand
+make_node() {
+    major=$(awk -v name="$1" '$2 == name { print $1 }' /proc/devices)
+    rm -f "/dev/$1"
+    mknod "/dev/$1" c "$major" 0
+}
+
+echo "== pipe"
+insmod "$REPO/pipe/pipe.ko"
+make_node char_pipe_dev
+"$BENCH/drvbench" pipe-throughput --dev /dev/char_pipe_dev > "$OUT/pipe_throughput.json"
+"$BENCH/drvbench" pipe-pingpong --dev /dev/char_pipe_dev > "$OUT/pipe_pingpong.json"
+rmmod pipe
+
+echo "== pipe (spill to $SPILL_FILE)"
+insmod "$REPO/pipe/pipe.ko" spill_path="$SPILL_FILE"
+make_node char_pipe_dev
+"$BENCH/drvbench" pipe-throughput --dev /dev/char_pipe_dev > "$OUT/pipe_spill_throughput.json"
+rmmod pipe
+rm -f "$SPILL_FILE"
+
+echo "== simple_char"
+insmod "$REPO/simple_char/char_simp.ko"
+make_node char_simp_dev
+"$BENCH/drvbench" chardev --dev /dev/char_simp_dev --sizes 64,255 > "$OUT/char_simp_rw.json"
+rmmod char_simp
+
+echo "== dynamic_char"
+insmod "$REPO/dynamic_char/char_dyn.ko"
+make_node char_dyn_dev
+"$BENCH/drvbench" chardev --dev /dev/char_dyn_dev --sizes 64,4096,65536 > "$OUT/char_dyn_rw.json"
+"$BENCH/dyn_append" --dev /dev/char_dyn_dev > "$OUT/char_dyn_append.json"
+rmmod char_dyn
+
+echo "== ioctl_char"
+insmod "$REPO/ioctl_char/ioctl_driver.ko"
+make_node ioctl_char_dev
+"$BENCH/drvbench" chardev --dev /dev/ioctl_char_dev --sizes 64,255 > "$OUT/ioctl_char_rw.json"
+"$BENCH/ioctl_resize" --dev /dev/ioctl_char_dev > "$OUT/ioctl_char_resize.json"
+rmmod ioctl_driver
+
+echo "== kmicro"
+dmesg -C
+insmod "$BENCH/kmicro/kmicro.ko"
+rmmod kmicro
+dmesg | sed -n 's/.*kmicro: //p' | paste -sd, - | sed 's/^/{"bench": "kmicro", "results": [/; s/$/]}/' > "$OUT/kmicro.json"
+
+echo "== simple_block"
+insmod "$REPO/simple_block/block_simp.ko"
+udevadm settle 2>/dev/null || sleep 1
+for qd in $QUEUE_DEPTHS; do
+    IODEPTH=$qd fio --output-format=json --output="$OUT/srd_qd$qd.json" "$BENCH/fio/srd.fio"
+done
+rmmod block_simp
+
+echo "results in $OUT"
@@ -0,0 +1,24 @@
+#!/bin/sh
+# Build the modules and benchmarks, then run run_suite.sh inside a
+# throwaway virtme-ng (QEMU) guest so results from different commits are
+# taken on the same clean kernel.
+#
+#   bench/run_vm.sh [KERNEL_TREE]
+#
+# KERNEL_TREE is a built kernel source tree for vng to boot; by default the
+# host kernel and its /lib/modules build directory are used. Results land in
+# bench/results/<short commit>; compare two runs with bench/compare.py.
+set -eu
+
+REPO=$(cd "$(dirname "$0")/.." && pwd)
+KERNEL_TREE=${1:-}
+KDIR=${KERNEL_TREE:-/lib/modules/$(uname -r)/build}
+OUT=$REPO/bench/results/$(git -C "$REPO" rev-parse --short HEAD)
+
+for dir in pipe simple_char dynamic_char ioctl_char simple_block bench/kmicro; do
+    make -C "$KDIR" M="$REPO/$dir" modules
+done
+make -C "$REPO/bench"
+
+vng --run $KERNEL_TREE --user root --memory 1G --cpus 4 --rwdir "$REPO" \
+    -- "$REPO/bench/run_suite.sh" "$OUT"
@@ -0,0 +1,71 @@
+#ifndef DRV_STATS_H
+#define DRV_STATS_H
+
+#include <linux/kernel.h>
+#include <linux/percpu.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+// Per-CPU I/O counters shared by the character drivers. Updates are a
+// this_cpu op on the hot path; the totals are summed on demand when
+// /sys/kernel/debug/<device>/stats is read.
+struct drv_stats {
+    u64 reads;
+    u64 writes;
+    u64 read_bytes;
+    u64 write_bytes;
+    u64 blocked_waits; // Calls that had to sleep before they could proceed
+    u64 efaults;       // Calls that failed to copy to or from userspace
+    u64 opens;
+};
+
+// Account one completed read or write
+static inline void drv_stats_io(struct drv_stats __percpu *stats, bool is_write, ssize_t result) {
+    if (result == -EFAULT) {
+        this_cpu_inc(stats->efaults);
+    } else if (result >= 0 && is_write) {
+        this_cpu_inc(stats->writes);
+        this_cpu_add(stats->write_bytes, result);
+    } else if (result >= 0) {
+        this_cpu_inc(stats->reads);
+        this_cpu_add(stats->read_bytes, result);
+    }
+}
+
+static int drv_stats_show(struct seq_file *m, void *v) {
+    struct drv_stats __percpu *stats = (struct drv_stats __percpu __force *)m->private;
+    struct drv_stats sum = { 0 };
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        struct drv_stats *s = per_cpu_ptr(stats, cpu);
+
+        sum.reads += READ_ONCE(s->reads);
+        sum.writes += READ_ONCE(s->writes);
+        sum.read_bytes += READ_ONCE(s->read_bytes);
+        sum.write_bytes += READ_ONCE(s->write_bytes);
+        sum.blocked_waits += READ_ONCE(s->blocked_waits);
+        sum.efaults += READ_ONCE(s->efaults);
+        sum.opens += READ_ONCE(s->opens);
+    }
+
+    seq_printf(m, "reads %llu\n", sum.reads);
+    seq_printf(m, "writes %llu\n", sum.writes);
+    seq_printf(m, "read_bytes %llu\n", sum.read_bytes);
+    seq_printf(m, "write_bytes %llu\n", sum.write_bytes);
+    seq_printf(m, "blocked_waits %llu\n", sum.blocked_waits);
+    seq_printf(m, "efaults %llu\n", sum.efaults);
+    seq_printf(m, "opens %llu\n", sum.opens);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(drv_stats);
+
+// Create /sys/kernel/debug/<name>/stats. debugfs failures are not fatal.
+static inline struct dentry *drv_stats_debugfs_create(const char *name, struct drv_stats __percpu *stats) {
+    struct dentry *dir = debugfs_create_dir(name, NULL);
+
+    debugfs_create_file("stats", 0444, dir, (void __force *)stats, &drv_stats_fops);
+    return dir;
+}
+
+#endif
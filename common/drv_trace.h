@@ -0,0 +1,77 @@
+#ifndef DRV_TRACE_H
+#define DRV_TRACE_H
+
+// Tracepoint definitions shared by the character drivers. Each driver's trace
+// header sets TRACE_SYSTEM and expands these with its own prefix, giving
+// <sys>_io, <sys>_open and <sys>_release under events/<sys>/. The macros are
+// expanded on every pass that trace/define_trace.h makes over that header, so
+// this file only defines them once. Each driver's Makefile adds -I$(src) so
+// define_trace.h can find the header again by name.
+
+#define DRV_TRACE_FILE_EVENTS(sys)                                          \
+    DECLARE_EVENT_CLASS(sys##_file,                                         \
+        TP_PROTO(unsigned int f_flags),                                     \
+        TP_ARGS(f_flags),                                                   \
+        TP_STRUCT__entry(__field(unsigned int, f_flags)),                   \
+        TP_fast_assign(__entry->f_flags = f_flags;),                        \
+        TP_printk("f_flags=0x%x", __entry->f_flags)                         \
+    );                                                                      \
+    DEFINE_EVENT(sys##_file, sys##_open,                                    \
+        TP_PROTO(unsigned int f_flags),                                     \
+        TP_ARGS(f_flags)                                                    \
+    );                                                                      \
+    DEFINE_EVENT(sys##_file, sys##_release,                                 \
+        TP_PROTO(unsigned int f_flags),                                     \
+        TP_ARGS(f_flags)                                                    \
+    )
+
+// One event per completed read or write. latency_ns covers the whole call and
+// is only measured while the event is enabled.
+#define DRV_TRACE_IO_EVENT(sys)                                             \
+    TRACE_EVENT(sys##_io,                                                   \
+        TP_PROTO(bool is_write, size_t requested, ssize_t result, u64 latency_ns), \
+        TP_ARGS(is_write, requested, result, latency_ns),                   \
+        TP_STRUCT__entry(                                                   \
+            __field(bool, is_write)                                         \
+            __field(size_t, requested)                                      \
+            __field(ssize_t, result)                                        \
+            __field(u64, latency_ns)                                        \
+        ),                                                                  \
+        TP_fast_assign(                                                     \
+            __entry->is_write = is_write;                                   \
+            __entry->requested = requested;                                 \
+            __entry->result = result;                                       \
+            __entry->latency_ns = latency_ns;                               \
+        ),                                                                  \
+        TP_printk("op=%s requested=%zu result=%zd latency_ns=%llu",         \
+                  __entry->is_write ? "write" : "read", __entry->requested, \
+                  __entry->result, __entry->latency_ns)                     \
+    )
+
+// As DRV_TRACE_IO_EVENT, for drivers whose calls can sleep: blocked_ns is the
+// part of latency_ns spent waiting
+#define DRV_TRACE_BLOCKING_IO_EVENT(sys)                                    \
+    TRACE_EVENT(sys##_io,                                                   \
+        TP_PROTO(bool is_write, size_t requested, ssize_t result, u64 latency_ns, \
+                 u64 blocked_ns),                                           \
+        TP_ARGS(is_write, requested, result, latency_ns, blocked_ns),       \
+        TP_STRUCT__entry(                                                   \
+            __field(bool, is_write)                                         \
+            __field(size_t, requested)                                      \
+            __field(ssize_t, result)                                        \
+            __field(u64, latency_ns)                                        \
+            __field(u64, blocked_ns)                                        \
+        ),                                                                  \
+        TP_fast_assign(                                                     \
+            __entry->is_write = is_write;                                   \
+            __entry->requested = requested;                                 \
+            __entry->result = result;                                       \
+            __entry->latency_ns = latency_ns;                               \
+            __entry->blocked_ns = blocked_ns;                               \
+        ),                                                                  \
+        TP_printk("op=%s requested=%zu result=%zd latency_ns=%llu blocked_ns=%llu", \
+                  __entry->is_write ? "write" : "read", __entry->requested, \
+                  __entry->result, __entry->latency_ns, __entry->blocked_ns) \
+    )
+
+#endif
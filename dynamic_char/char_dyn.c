@@ -5,6 +5,13 @@
 #include <linux/types.h> //dev_t
 #include <linux/uaccess.h> //access userspace
 #include <linux/moduleparam.h> //access userspace
+#include <linux/mm.h> //kvmalloc
+#include <linux/slab.h>
+#include <linux/mutex.h>
+#include "../common/drv_stats.h"
+
+#define CREATE_TRACE_POINTS
+#include "char_dyn_trace.h"
 
 #define DEVICE_NAME "char_dyn_dev"
 
@@ -14,74 +21,189 @@ MODULE_DESCRIPTION("Dynamic character driver");
 
 static int major_num;
 static struct cdev le_cdev;
-static int size = 5;
-char *charArray;
-static int buffer_ptr = 0;
+static unsigned long max_size = 64UL << 20;
+
+module_param(max_size, ulong, 0644);
+MODULE_PARM_DESC(max_size, "Upper bound on the device contents in bytes (default: 64 MiB)");
+
+// The contents live in a list of page-sized chunks rather than one flat
+// array. Growing the device only allocates new chunks, so appending never
+// recopies existing data; the chunk table itself grows geometrically and
+// falls back to vmalloc when it gets large.
+#define CHUNK_SIZE PAGE_SIZE
+#define MIN_CHUNK_SLOTS 8
+
+static char **chunks;              // Table of chunk pointers
+static size_t nr_chunks;           // Chunks currently allocated
+static size_t chunk_slots;         // Capacity of the chunk table
+static size_t buffer_ptr = 0;      // Number of valid bytes in the device
+static DEFINE_MUTEX(buffer_lock);  // Serializes access to the chunks and buffer_ptr
+static struct drv_stats __percpu *stats; // Exposed in /sys/kernel/debug/char_dyn_dev/stats
+static struct dentry *debug_dir;
+
+// Make room for at least len bytes. Caller holds buffer_lock.
+static int dyn_reserve(size_t len) {
+    size_t needed = DIV_ROUND_UP(len, CHUNK_SIZE);
+
+    if (needed > chunk_slots) {
+        size_t new_slots = max3(chunk_slots * 2, needed, (size_t)MIN_CHUNK_SLOTS);
+        char **new_chunks = kvmalloc_array(new_slots, sizeof(*new_chunks), GFP_KERNEL);
+
+        if (!new_chunks) {
+            return -ENOMEM;
+        }
+        if (nr_chunks) {
+            memcpy(new_chunks, chunks, nr_chunks * sizeof(*chunks));
+        }
+        kvfree(chunks);
+        chunks = new_chunks;
+        chunk_slots = new_slots;
+        pr_debug("char_dyn_dev: chunk table grown to %zu slots\n", chunk_slots);
+    }
+
+    while (nr_chunks < needed) {
+        // Zeroed so a write past the end leaves a hole that reads back as zeroes
+        char *chunk = (char *)get_zeroed_page(GFP_KERNEL);
+
+        if (!chunk) {
+            return -ENOMEM;
+        }
+        chunks[nr_chunks++] = chunk;
+    }
+
+    return 0;
+}
+
+// Drop all contents. Caller holds buffer_lock.
+static void dyn_truncate(void) {
+    while (nr_chunks > 0) {
+        free_page((unsigned long)chunks[--nr_chunks]);
+    }
+    kvfree(chunks);
+    chunks = NULL;
+    chunk_slots = 0;
+    buffer_ptr = 0;
+}
 
 static int simple_char_open(struct inode *inode, struct file *instance) {
-    printk(KERN_INFO "char_dyn_dev: opened device\n");
+    // Keep the old "each write session replaces the contents" behaviour for
+    // shell redirects such as `echo foo > /dev/char_dyn_dev`
+    if ((instance->f_mode & FMODE_WRITE) && (instance->f_flags & O_TRUNC)) {
+        mutex_lock(&buffer_lock);
+        dyn_truncate();
+        mutex_unlock(&buffer_lock);
+    }
+    this_cpu_inc(stats->opens);
+    trace_char_dyn_open(instance->f_flags);
     return 0;
 }
 
-ssize_t dev_read(struct file *FILE, char *user_buffer, size_t count, loff_t *offset) {
-    int to_cpy, not_cpy, delta;
+static loff_t dev_llseek(struct file *file, loff_t offset, int whence) {
+    return generic_file_llseek_size(file, offset, whence, max_size, READ_ONCE(buffer_ptr));
+}
 
-    to_cpy = min_t(int, count, buffer_ptr - *offset);
-    not_cpy = copy_to_user(user_buffer, charArray + *offset, to_cpy);
+static ssize_t do_read(char __user *user_buffer, size_t count, loff_t *offset) {
+    loff_t pos = *offset;
+    size_t to_cpy, done = 0;
 
-    if (not_cpy != 0) {
-        return -EFAULT;
+    mutex_lock(&buffer_lock);
+    if (pos >= buffer_ptr) {
+        mutex_unlock(&buffer_lock);
+        return 0;
     }
+    to_cpy = min_t(size_t, count, buffer_ptr - pos);
 
-    delta = to_cpy - not_cpy;
+    // Walk the chunks covering [pos, pos + to_cpy)
+    while (done < to_cpy) {
+        size_t chunk_off = (pos + done) % CHUNK_SIZE;
+        size_t len = min_t(size_t, to_cpy - done, CHUNK_SIZE - chunk_off);
+        char *chunk = chunks[(pos + done) / CHUNK_SIZE];
 
-    *offset += delta;
-    printk(KERN_INFO "char_dyn_dev: read %d bytes\n", delta);
+        if (copy_to_user(user_buffer + done, chunk + chunk_off, len)) {
+            break;
+        }
+        done += len;
+    }
+    mutex_unlock(&buffer_lock);
+
+    if (done == 0) {
+        return -EFAULT;
+    }
 
-    return delta;
+    *offset = pos + done;
+    return done;
 }
 
-ssize_t dev_write (struct file *File, const char *user_buffer, size_t count, loff_t *offset){
-    buffer_ptr = 0;
-    int to_cpy, not_cpy, delta;
-
-    printk("dynamic_char_dev: new size - %d", count);      
-    char *newArray = kmalloc(count * sizeof(char), GFP_KERNEL);
-    for (int i = 0; i<buffer_ptr; i++) {
-        newArray[i] = charArray[i];
-    };
-    kfree(charArray);
-    charArray = newArray;
-    
-    size = count;
-    to_cpy = count;
-    
-    printk(KERN_INFO "char_dyn_dev: count: %d length of charArray: %d buffer_ptr: %d bytes to copy: %d", count, size, buffer_ptr, to_cpy);
+static ssize_t do_write(struct file *File, const char __user *user_buffer, size_t count, loff_t *offset) {
+    loff_t pos;
+    size_t to_cpy, done = 0;
+    int ret;
 
-    not_cpy = copy_from_user(charArray + buffer_ptr, user_buffer, to_cpy);
-    
-    if (not_cpy != 0) {
+    if (count == 0) {
+        return 0;
+    }
+
+    mutex_lock(&buffer_lock);
+    pos = (File->f_flags & O_APPEND) ? buffer_ptr : *offset;
+    if (pos >= max_size) {
+        mutex_unlock(&buffer_lock);
+        return -ENOSPC;
+    }
+    to_cpy = min_t(size_t, count, max_size - pos);
+
+    ret = dyn_reserve(pos + to_cpy);
+    if (ret) {
+        mutex_unlock(&buffer_lock);
+        return ret;
+    }
+
+    while (done < to_cpy) {
+        size_t chunk_off = (pos + done) % CHUNK_SIZE;
+        size_t len = min_t(size_t, to_cpy - done, CHUNK_SIZE - chunk_off);
+        char *chunk = chunks[(pos + done) / CHUNK_SIZE];
+
+        if (copy_from_user(chunk + chunk_off, user_buffer + done, len)) {
+            break;
+        }
+        done += len;
+    }
+
+    if (pos + done > buffer_ptr) {
+        buffer_ptr = pos + done;
+    }
+    mutex_unlock(&buffer_lock);
+
+    if (done == 0) {
         return -EFAULT;
     }
 
-    buffer_ptr += to_cpy;
-    delta = to_cpy - not_cpy;
+    *offset = pos + done;
+    return done;
+}
 
-    printk(KERN_INFO "char_dyn_dev: written ");
-    
-    /*for (int i = 0; i<buffer_ptr; i++) {  //for debugging
-        printk(KERN_INFO "%c", charArray[i]);
-    };*/
-    
-    printk(KERN_INFO "char_dyn_dev: written %d bytes\n", to_cpy);
-    return delta;
+ssize_t dev_read(struct file *FILE, char *user_buffer, size_t count, loff_t *offset) {
+    u64 start = trace_char_dyn_io_enabled() ? ktime_get_ns() : 0;
+    ssize_t result = do_read(user_buffer, count, offset);
+
+    drv_stats_io(stats, false, result);
+    trace_char_dyn_io(false, count, result, start ? ktime_get_ns() - start : 0);
+    return result;
+}
+
+ssize_t dev_write (struct file *File, const char *user_buffer, size_t count, loff_t *offset){
+    u64 start = trace_char_dyn_io_enabled() ? ktime_get_ns() : 0;
+    ssize_t result = do_write(File, user_buffer, count, offset);
+
+    drv_stats_io(stats, true, result);
+    trace_char_dyn_io(true, count, result, start ? ktime_get_ns() - start : 0);
+    return result;
 }
 
 static int simple_char_release(struct inode *inode, struct file *instance) {
     /*for (int i = 0; i<buffer_ptr; i++) {  //for debugging
         printk(KERN_INFO "%c", charArray[i]);
     };*/
-    printk(KERN_INFO "char_dyn_dev: driver closed\n");
+    trace_char_dyn_release(instance->f_flags);
     return 0;
 }
 
@@ -89,6 +211,7 @@ static const struct file_operations fops = {
     .owner = THIS_MODULE,
     .open = simple_char_open,
     .release = simple_char_release,
+    .llseek = dev_llseek,
     .read = dev_read,
     .write = dev_write,
 };
@@ -97,20 +220,18 @@ static int __init simple_char_init(void) {
     dev_t dev_num;
     int regval;
 
-    printk(KERN_INFO "char_dyn_dev: Buffer size: %d\n", size);
-    charArray = kmalloc(size * sizeof(char), GFP_KERNEL);
-    if (charArray == NULL) {
+    printk(KERN_INFO "char_dyn_dev: Maximum size: %lu\n", max_size);
+
+    stats = alloc_percpu(struct drv_stats);
+    if (stats == NULL) {
         return -ENOMEM;
     }
 
-    for (int i = 0; i<size; i++) {
-        charArray[i]=' ';
-    };
-
     regval = alloc_chrdev_region(&dev_num, 0, 1, DEVICE_NAME);
     
     if (regval < 0) {
         printk(KERN_ALERT "char_dyn_dev: Memory allocation for major number failed\n");
+        free_percpu(stats);
         return regval;
     }
 
@@ -122,13 +243,16 @@ static int __init simple_char_init(void) {
     
     if (regval < 0) {
         printk(KERN_ALERT "char_dyn_dev: Failed to load device\n");
+        unregister_chrdev_region(dev_num, 1);
+        free_percpu(stats);
         return regval;
     }
     
     else if (regval > 0) {
         printk(KERN_ALERT "returned value:%d\n", regval);
     }
-    
+
+    debug_dir = drv_stats_debugfs_create(DEVICE_NAME, stats);
     return 0;
 }
 
@@ -136,6 +260,9 @@ static void __exit simple_char_exit(void) {
     dev_t dev_num = MKDEV(major_num, 0);
     cdev_del(&le_cdev);
     unregister_chrdev_region(dev_num, 1);
+    dyn_truncate();
+    debugfs_remove(debug_dir);
+    free_percpu(stats);
     printk(KERN_INFO "char_dyn: Exited\n");
 }
 
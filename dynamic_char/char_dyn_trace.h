@@ -0,0 +1,20 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM char_dyn
+
+#if !defined(CHAR_DYN_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define CHAR_DYN_TRACE_H
+
+#include <linux/tracepoint.h>
+#include "../common/drv_trace.h"
+
+DRV_TRACE_IO_EVENT(char_dyn);
+DRV_TRACE_FILE_EVENTS(char_dyn);
+
+#endif
+
+// This part must be outside the include guard
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE char_dyn_trace
+#include <trace/define_trace.h>
@@ -0,0 +1,77 @@
+#ifndef IOCTL_CHAR_H
+#define IOCTL_CHAR_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+// Layout of an mmap() of ioctl_char_dev. Page 0 of the mapping holds a
+// struct ioctl_char_header and the data buffer starts at page 1 (offset
+// sysconf(_SC_PAGESIZE)). Page 0 can only be mapped read-only; map from
+// page 1 onwards to get a writable view of the data. The buffer cannot be
+// resized while any mapping exists.
+//
+// generation is odd while a write() is copying into the buffer and
+// advances by two per completed write, so a reader that sees the same even
+// value before and after reading the data got a consistent snapshot.
+struct ioctl_char_header {
+    __u64 generation;
+    __u64 used;  // Number of valid bytes in the data buffer
+    __u64 size;  // Capacity of the data buffer
+};
+
+// --- Legacy commands ---
+// MAX_SZ and CUR_SZ store an int through the pointer argument; INC_SZ takes
+// the new buffer size by value.
+#define MAX_SZ _IOR(0, 0, int)
+#define CUR_SZ _IOR(0, 1, int)
+#define INC_SZ _IOR(0, 2, int)
+
+// --- Versioned ABI ---
+// Bump IOCTL_CHAR_ABI_VERSION on any incompatible change to the structures
+// below. IOCTL_CHAR_GET_VERSION lets callers check before issuing anything else.
+#define IOCTL_CHAR_ABI_VERSION 1
+#define IOCTL_CHAR_MAGIC 'c'
+
+struct ioctl_char_info {
+    __u32 abi_version;
+    __u32 reserved;    // Zero
+    __u64 size;        // Capacity of the data buffer
+    __u64 used;        // Number of valid bytes in the data buffer
+    __u64 generation;  // Same value as ioctl_char_header.generation
+};
+
+// Operations accepted by IOCTL_CHAR_BATCH
+enum ioctl_char_op_code {
+    IOCTL_CHAR_OP_GET_INFO = 1, // Store a struct ioctl_char_info at buf
+    IOCTL_CHAR_OP_RESIZE   = 2, // Resize the buffer to len bytes
+    IOCTL_CHAR_OP_READ_AT  = 3, // Copy up to len bytes at offset into buf
+    IOCTL_CHAR_OP_WRITE_AT = 4, // Copy len bytes from buf to offset
+};
+
+struct ioctl_char_op {
+    __u32 op;       // enum ioctl_char_op_code
+    __u32 reserved; // Zero
+    __s64 result;   // Out: bytes transferred, 0, or -errno
+    __u64 offset;
+    __u64 len;
+    __u64 buf;      // User pointer
+};
+
+// Stop at the first failing op instead of running the rest of the batch
+#define IOCTL_CHAR_BATCH_STOP_ON_ERROR (1U << 0)
+#define IOCTL_CHAR_BATCH_MAX 1024
+
+struct ioctl_char_batch {
+    __u32 version;   // IOCTL_CHAR_ABI_VERSION
+    __u32 count;     // Number of entries at ops, at most IOCTL_CHAR_BATCH_MAX
+    __u64 ops;       // User pointer to struct ioctl_char_op[count]
+    __u32 flags;     // IOCTL_CHAR_BATCH_*
+    __u32 completed; // Out: number of ops that were run
+};
+
+#define IOCTL_CHAR_GET_VERSION _IOR(IOCTL_CHAR_MAGIC, 0, __u32)
+#define IOCTL_CHAR_GET_INFO    _IOR(IOCTL_CHAR_MAGIC, 1, struct ioctl_char_info)
+#define IOCTL_CHAR_RESIZE      _IOW(IOCTL_CHAR_MAGIC, 2, __u64)
+#define IOCTL_CHAR_BATCH       _IOWR(IOCTL_CHAR_MAGIC, 3, struct ioctl_char_batch)
+
+#endif
@@ -6,11 +6,22 @@
 #include <linux/uaccess.h> //access userspace
 #include <linux/moduleparam.h> //access userspace
 #include <linux/ioctl.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/vmalloc.h>
+#include <linux/slab.h>
+#include <linux/string.h> //memdup_array_user
+#include <linux/srcu.h>
+#include <linux/poll.h>
+#include <linux/wait.h>
+
+#include "ioctl_char.h"
+#include "../common/drv_stats.h"
+
+#define CREATE_TRACE_POINTS
+#include "ioctl_char_trace.h"
 
 #define DEVICE_NAME "ioctl_char_dev"
-#define MAX_SZ _IOR(MAJOR(0), 0, int)
-#define CUR_SZ _IOR(MAJOR(0), 1, int)
-#define INC_SZ _IOR(MAJOR(0), 2, int)
 
 
 MODULE_LICENSE("GPL");
@@ -20,21 +31,153 @@ MODULE_DESCRIPTION("Simple character driver with ioctl");
 static int major_num;
 static struct cdev le_cdev;
 static int size = 255;
-char *charArray;
 static int buffer_ptr = 0;
+static DEFINE_MUTEX(buffer_lock);        // Serializes writers and resizing
+static atomic_t mmap_count = ATOMIC_INIT(0); // Live mappings of the buffer
+// Orders mmap() against a resize swapping the buffer. Never held across a user
+// copy: mmap() runs under the caller's mmap_lock, which a faulting copy takes.
+static DEFINE_MUTEX(map_lock);
+
+static bool wait_for_change = false;
+static DECLARE_WAIT_QUEUE_HEAD(change_wait); // Woken after every completed write or resize
+static struct drv_stats __percpu *stats; // Exposed in /sys/kernel/debug/ioctl_char_dev/stats
+static struct dentry *debug_dir;
+
+module_param(size, int, 0444);
+module_param(wait_for_change, bool, 0644);
+MODULE_PARM_DESC(wait_for_change, "A read at offset 0 blocks until the contents change (default: false)");
+
+// Per-open state, kept in file->private_data
+struct reader_state {
+    u64 seen_gen; // Generation observed by this file's last read
+};
+
+// The buffer is published through SRCU. dev_read() picks up the current
+// descriptor without taking buffer_lock (and may fault in copy_to_user while
+// holding it); a resize builds a new descriptor off to the side, swaps the
+// pointer and frees the old buffer once no reader can still be using it.
+struct char_buffer {
+    struct ioctl_char_header *header; // Start of the mmap()able region
+    char *data;                       // Data buffer, one page after header
+    struct rcu_head rcu;
+};
+
+static struct char_buffer __rcu *cur_buf;
+DEFINE_STATIC_SRCU(buffer_srcu);
+
+// Allocate a zeroed, page-aligned header + data region that can be mapped to userspace
+static struct char_buffer *alloc_buffer(int new_size) {
+    struct char_buffer *buf = kmalloc(sizeof(*buf), GFP_KERNEL);
+
+    if (buf == NULL) {
+        return NULL;
+    }
+    buf->header = vmalloc_user(PAGE_SIZE + PAGE_ALIGN(new_size));
+    if (buf->header == NULL) {
+        kfree(buf);
+        return NULL;
+    }
+    buf->header->size = new_size;
+    buf->data = (char *)buf->header + PAGE_SIZE;
+    return buf;
+}
+
+static void free_buffer(struct char_buffer *buf) {
+    vfree(buf->header);
+    kfree(buf);
+}
+
+static void free_buffer_rcu(struct rcu_head *rcu) {
+    free_buffer(container_of(rcu, struct char_buffer, rcu));
+}
 
-module_param(size, int, 0644);
+// Writer-side access to the current buffer. Caller holds buffer_lock or
+// map_lock; a resize swaps the pointer under both.
+static struct char_buffer *locked_buf(void) {
+    return rcu_dereference_protected(cur_buf, lockdep_is_held(&buffer_lock) ||
+                                              lockdep_is_held(&map_lock));
+}
+
+// Mark the buffer as being modified for readers polling the mapped header.
+// Caller holds buffer_lock.
+static void begin_update(void) {
+    struct ioctl_char_header *header = locked_buf()->header;
+
+    WRITE_ONCE(header->generation, header->generation + 1);
+    smp_wmb();
+}
+
+static void end_update(void) {
+    struct ioctl_char_header *header = locked_buf()->header;
+
+    WRITE_ONCE(header->used, buffer_ptr);
+    smp_store_release(&header->generation, header->generation + 1);
+    wake_up_interruptible_poll(&change_wait, EPOLLIN | EPOLLRDNORM);
+}
+
+// Generation of the last completed write (an in-progress write makes it odd)
+static u64 completed_generation(struct char_buffer *buf) {
+    return smp_load_acquire(&buf->header->generation) & ~1ULL;
+}
+
+static bool changed_since_read(struct reader_state *rs) {
+    int idx = srcu_read_lock(&buffer_srcu);
+    bool changed = completed_generation(srcu_dereference(cur_buf, &buffer_srcu)) != READ_ONCE(rs->seen_gen);
+
+    srcu_read_unlock(&buffer_srcu, idx);
+    return changed;
+}
 
 static int simple_char_open(struct inode *inode, struct file *instance) {
-    printk(KERN_INFO "ioctl_char_dev: opened device\n");
+    struct reader_state *rs = kzalloc(sizeof(struct reader_state), GFP_KERNEL);
+
+    if (rs == NULL) {
+        return -ENOMEM;
+    }
+    // Odd, so it never matches a completed generation: the existing contents,
+    // including the initial ones from before any write, are new to a fresh reader
+    rs->seen_gen = U64_MAX;
+    instance->private_data = rs;
+    this_cpu_inc(stats->opens);
+    trace_ioctl_char_open(instance->f_flags);
     return 0;
 }
 
-ssize_t dev_read(struct file *FILE, char *user_buffer, size_t count, loff_t *offset) {
-    int to_cpy, not_cpy, delta;
+static ssize_t do_read(struct file *FILE, char __user *user_buffer, size_t count, loff_t *offset,
+                       u64 *blocked_ns) {
+    struct reader_state *rs = FILE->private_data;
+    struct char_buffer *buf;
+    int to_cpy, not_cpy, delta, used, idx;
+
+    // Replaces busy-polling: a read from the start waits for the next write
+    if (wait_for_change && *offset == 0 && !changed_since_read(rs)) {
+        u64 start;
+        int interrupted;
 
-    to_cpy = min_t(int, count, buffer_ptr - *offset);
-    not_cpy = copy_to_user(user_buffer, charArray + *offset, to_cpy);
+        if (FILE->f_flags & O_NONBLOCK) {
+            return -EAGAIN;
+        }
+        start = ktime_get_ns();
+        interrupted = wait_event_interruptible(change_wait, changed_since_read(rs));
+        this_cpu_inc(stats->blocked_waits);
+        *blocked_ns = ktime_get_ns() - start;
+        if (interrupted) {
+            return -ERESTARTSYS;
+        }
+    }
+
+    // Never blocks on writers or a concurrent resize
+    idx = srcu_read_lock(&buffer_srcu);
+    buf = srcu_dereference(cur_buf, &buffer_srcu);
+    WRITE_ONCE(rs->seen_gen, completed_generation(buf));
+    used = READ_ONCE(buf->header->used);
+    if (*offset >= used) {
+        srcu_read_unlock(&buffer_srcu, idx);
+        return 0;
+    }
+    to_cpy = min_t(int, count, used - *offset);
+    not_cpy = copy_to_user(user_buffer, buf->data + *offset, to_cpy);
+    srcu_read_unlock(&buffer_srcu, idx);
 
     if (not_cpy != 0) {
         return -EFAULT;
@@ -43,69 +186,312 @@ ssize_t dev_read(struct file *FILE, char *user_buffer, size_t count, loff_t *off
     delta = to_cpy - not_cpy;
 
     *offset += delta;
-    printk(KERN_INFO "ioctl_char_dev: read %d bytes\n", delta);
-
     return delta;
 }
 
-ssize_t dev_write (struct file *File, const char *user_buffer, size_t count, loff_t *offset){
-    buffer_ptr = 0;
+static ssize_t do_write(const char __user *user_buffer, size_t count) {
     int to_cpy, not_cpy, delta;
 
+    mutex_lock(&buffer_lock);
+    buffer_ptr = 0;
     to_cpy = min_t(int, count, size - buffer_ptr);
-    printk(KERN_INFO "ioctl_char_dev: count: %d length of charArray: %d buffer_ptr: %d bytes to copy: %d", count, size, buffer_ptr, to_cpy);
 
-    not_cpy = copy_from_user(charArray + buffer_ptr, user_buffer, to_cpy);
-    
+    begin_update();
+    not_cpy = copy_from_user(locked_buf()->data + buffer_ptr, user_buffer, to_cpy);
+    buffer_ptr += to_cpy - not_cpy;
+    end_update();
+    mutex_unlock(&buffer_lock);
+
     if (not_cpy != 0) {
         return -EFAULT;
     }
-
-    buffer_ptr += to_cpy;
     delta = to_cpy - not_cpy;
-
-    printk(KERN_INFO "ioctl_char_dev: written ");
-    
-    /*for (int i = 0; i<buffer_ptr; i++) {  //for debugging
-        printk(KERN_INFO "%c", charArray[i]);
-    };*/
-    
-    printk(KERN_INFO "ioctl_char_dev: written %d bytes\n", to_cpy);
     return delta;
 }
 
+ssize_t dev_read(struct file *FILE, char *user_buffer, size_t count, loff_t *offset) {
+    u64 start = trace_ioctl_char_io_enabled() ? ktime_get_ns() : 0;
+    u64 blocked_ns = 0;
+    ssize_t result = do_read(FILE, user_buffer, count, offset, &blocked_ns);
+
+    drv_stats_io(stats, false, result);
+    trace_ioctl_char_io(false, count, result, start ? ktime_get_ns() - start : 0, blocked_ns);
+    return result;
+}
+
+ssize_t dev_write (struct file *File, const char *user_buffer, size_t count, loff_t *offset){
+    u64 start = trace_ioctl_char_io_enabled() ? ktime_get_ns() : 0;
+    ssize_t result = do_write(user_buffer, count);
+
+    drv_stats_io(stats, true, result);
+    trace_ioctl_char_io(true, count, result, start ? ktime_get_ns() - start : 0, 0);
+    return result;
+}
+
 static int simple_char_release(struct inode *inode, struct file *instance) {
     /*for (int i = 0; i<buffer_ptr; i++) {  //for debugging
         printk(KERN_INFO "%c", charArray[i]);
     };*/
-    printk(KERN_INFO "ioctl_char_dev: driver closed\n");
+    kfree(instance->private_data);
+    trace_ioctl_char_release(instance->f_flags);
+    return 0;
+}
+
+// Resize the buffer, keeping as much of the contents as fits. Readers keep
+// using the old buffer until they drop out of their SRCU read section.
+// Caller holds buffer_lock.
+static int resize_buffer(u64 new_size) {
+    struct char_buffer *old_buf = locked_buf();
+    struct char_buffer *new_buf;
+    int new_used;
+
+    pr_debug("ioctl_char_dev: new size - %llu\n", new_size);
+    if (new_size == 0 || new_size > INT_MAX - PAGE_SIZE) {
+        return -EINVAL;
+    }
+
+    new_buf = alloc_buffer(new_size);
+    if (new_buf == NULL) {
+        return -ENOMEM;
+    }
+    new_used = min_t(int, buffer_ptr, new_size);
+    memcpy(new_buf->data, old_buf->data, new_used);
+    new_buf->header->generation = old_buf->header->generation + 2;
+    new_buf->header->used = new_used;
+
+    mutex_lock(&map_lock);
+    // Mappings would keep showing the old buffer
+    if (atomic_read(&mmap_count) > 0) {
+        mutex_unlock(&map_lock);
+        free_buffer(new_buf);
+        return -EBUSY;
+    }
+    rcu_assign_pointer(cur_buf, new_buf);
+    mutex_unlock(&map_lock);
+
+    buffer_ptr = new_used;
+    size = new_size;
+    call_srcu(&buffer_srcu, &old_buf->rcu, free_buffer_rcu);
+    wake_up_interruptible_poll(&change_wait, EPOLLIN | EPOLLRDNORM);
     return 0;
 }
 
+// Caller holds buffer_lock
+static void fill_info(struct ioctl_char_info *info) {
+    memset(info, 0, sizeof(*info));
+    info->abi_version = IOCTL_CHAR_ABI_VERSION;
+    info->size = size;
+    info->used = buffer_ptr;
+    info->generation = locked_buf()->header->generation;
+}
+
+// Copy up to len bytes at offset out to userspace. Caller holds buffer_lock.
+static ssize_t read_at(u64 offset, char __user *user_buffer, u64 len) {
+    size_t to_cpy;
+
+    if (offset >= buffer_ptr) {
+        return 0;
+    }
+    to_cpy = min_t(u64, len, buffer_ptr - offset);
+    if (copy_to_user(user_buffer, locked_buf()->data + offset, to_cpy)) {
+        return -EFAULT;
+    }
+    return to_cpy;
+}
+
+// Copy up to len bytes from userspace to offset, extending the valid data.
+// Caller holds buffer_lock.
+static ssize_t write_at(u64 offset, const char __user *user_buffer, u64 len) {
+    size_t to_cpy, not_cpy;
+
+    if (len == 0) {
+        return 0;
+    }
+    if (offset >= size) {
+        return -ENOSPC;
+    }
+    to_cpy = min_t(u64, len, size - offset);
+
+    begin_update();
+    not_cpy = copy_from_user(locked_buf()->data + offset, user_buffer, to_cpy);
+    if (offset + to_cpy - not_cpy > buffer_ptr) {
+        buffer_ptr = offset + to_cpy - not_cpy;
+    }
+    end_update();
+
+    if (not_cpy == to_cpy) {
+        return -EFAULT;
+    }
+    return to_cpy - not_cpy;
+}
+
+// Run one batched op. Caller holds buffer_lock.
+static s64 run_op(struct ioctl_char_op *op) {
+    void __user *user_buffer = u64_to_user_ptr(op->buf);
+    struct ioctl_char_info info;
+
+    if (op->reserved) {
+        return -EINVAL;
+    }
+
+    switch (op->op) {
+    case IOCTL_CHAR_OP_GET_INFO:
+        fill_info(&info);
+        return copy_to_user(user_buffer, &info, sizeof(info)) ? -EFAULT : 0;
+    case IOCTL_CHAR_OP_RESIZE:
+        return resize_buffer(op->len);
+    case IOCTL_CHAR_OP_READ_AT:
+        return read_at(op->offset, user_buffer, op->len);
+    case IOCTL_CHAR_OP_WRITE_AT:
+        return write_at(op->offset, user_buffer, op->len);
+    default:
+        return -EINVAL;
+    }
+}
+
+// Run a whole array of ops in one kernel entry and one lock round trip,
+// reporting each op's outcome in its result field.
+static long run_batch(struct ioctl_char_batch __user *user_batch) {
+    struct ioctl_char_batch batch;
+    struct ioctl_char_op *ops;
+    u32 completed, i;
+    long answer = 0;
+
+    if (copy_from_user(&batch, user_batch, sizeof(batch))) {
+        return -EFAULT;
+    }
+    if (batch.version != IOCTL_CHAR_ABI_VERSION) {
+        return -EPROTONOSUPPORT;
+    }
+    if ((batch.flags & ~IOCTL_CHAR_BATCH_STOP_ON_ERROR) || batch.count > IOCTL_CHAR_BATCH_MAX) {
+        return -EINVAL;
+    }
+
+    ops = memdup_array_user(u64_to_user_ptr(batch.ops), batch.count, sizeof(*ops));
+    if (IS_ERR(ops)) {
+        return PTR_ERR(ops);
+    }
+
+    mutex_lock(&buffer_lock);
+    for (completed = 0; completed < batch.count; completed++) {
+        ops[completed].result = run_op(&ops[completed]);
+        if (ops[completed].result < 0 && (batch.flags & IOCTL_CHAR_BATCH_STOP_ON_ERROR)) {
+            completed++;
+            break;
+        }
+    }
+    mutex_unlock(&buffer_lock);
+
+    for (i = completed; i < batch.count; i++) {
+        ops[i].result = -ECANCELED;
+    }
+
+    if (copy_to_user(u64_to_user_ptr(batch.ops), ops, array_size(batch.count, sizeof(*ops))) ||
+        put_user(completed, &user_batch->completed)) {
+        answer = -EFAULT;
+    }
+    kfree(ops);
+    return answer;
+}
+
 static long int mon_ioctl(struct file *file, unsigned cmd, unsigned long arg){
-    printk(KERN_INFO "ioctl_char_dev: ioctl function call, cmd: %d", cmd); 
-    int answer;
+    void __user *argp = (void __user *)arg;
+    struct ioctl_char_info info;
+    u64 new_size;
+    long answer = 0;
+
+    pr_debug("ioctl_char_dev: ioctl function call, cmd: %u\n", cmd);
     switch (cmd)
     {
     case MAX_SZ:
-        printk(KERN_INFO "ioctl_char_dev: device size: %d",size);
+        answer = put_user(READ_ONCE(size), (int __user *)argp);
         break;
     case CUR_SZ:
-        printk(KERN_INFO "ioctl_char_dev: current size: %d",buffer_ptr);
+        answer = put_user(READ_ONCE(buffer_ptr), (int __user *)argp);
+        break;
     case INC_SZ:
-        int inc_value = (int)arg; 
-        printk("ioctl_char_dev: new size - %d", inc_value);      
-        char *newArray = kmalloc(inc_value * sizeof(char), GFP_KERNEL);
-        for (int i = 0; i<buffer_ptr; i++) {
-            newArray[i] = charArray[i];
-        };
-        kfree(charArray);
-        charArray = newArray;
-        printk(KERN_INFO "ioctl_char_dev: array content - %s\n", charArray);
+        // Legacy command: the size is passed by value
+        mutex_lock(&buffer_lock);
+        answer = resize_buffer((u64)(int)arg);
+        mutex_unlock(&buffer_lock);
+        break;
+    case IOCTL_CHAR_GET_VERSION:
+        answer = put_user((__u32)IOCTL_CHAR_ABI_VERSION, (__u32 __user *)argp);
+        break;
+    case IOCTL_CHAR_GET_INFO:
+        mutex_lock(&buffer_lock);
+        fill_info(&info);
+        mutex_unlock(&buffer_lock);
+        if (copy_to_user(argp, &info, sizeof(info))) {
+            answer = -EFAULT;
+        }
+        break;
+    case IOCTL_CHAR_RESIZE:
+        if (get_user(new_size, (u64 __user *)argp)) {
+            answer = -EFAULT;
+            break;
+        }
+        mutex_lock(&buffer_lock);
+        answer = resize_buffer(new_size);
+        mutex_unlock(&buffer_lock);
+        break;
+    case IOCTL_CHAR_BATCH:
+        answer = run_batch(argp);
+        break;
     default:
+        answer = -ENOTTY;
         break;
     }
-    return 0;
+    return answer;
+}
+
+// Readable once a write has completed since this file last read the device
+static __poll_t dev_poll(struct file *file, poll_table *wait) {
+    __poll_t mask = EPOLLOUT | EPOLLWRNORM;
+
+    poll_wait(file, &change_wait, wait);
+    if (changed_since_read(file->private_data)) {
+        mask |= EPOLLIN | EPOLLRDNORM;
+    }
+    return mask;
+}
+
+static void dev_vma_open(struct vm_area_struct *vma) {
+    atomic_inc(&mmap_count);
+}
+
+static void dev_vma_close(struct vm_area_struct *vma) {
+    atomic_dec(&mmap_count);
+}
+
+static const struct vm_operations_struct dev_vm_ops = {
+    .open = dev_vma_open,
+    .close = dev_vma_close,
+};
+
+// Map the header page and data buffer straight into the caller. The header
+// page is only ever mapped read-only so the generation cannot be forged.
+static int dev_mmap(struct file *file, struct vm_area_struct *vma) {
+    int ret;
+
+    if (vma->vm_pgoff == 0) {
+        if (vma->vm_flags & VM_WRITE) {
+            return -EPERM;
+        }
+        vm_flags_clear(vma, VM_MAYWRITE);
+    }
+
+    // Not buffer_lock: writers hold it across copy_from_user()
+    mutex_lock(&map_lock);
+    // Fails with -EINVAL if the range runs past the end of the buffer
+    ret = remap_vmalloc_range(vma, locked_buf()->header, vma->vm_pgoff);
+    if (ret == 0) {
+        vma->vm_ops = &dev_vm_ops;
+        atomic_inc(&mmap_count); // ->open is not called for the initial mapping
+    }
+    mutex_unlock(&map_lock);
+
+    return ret;
 }
 
 static const struct file_operations fops = {
@@ -114,10 +500,14 @@ static const struct file_operations fops = {
     .release = simple_char_release,
     .read = dev_read,
     .write = dev_write,
-    .unlocked_ioctl = mon_ioctl
+    .unlocked_ioctl = mon_ioctl,
+    .compat_ioctl = compat_ptr_ioctl, // Fixed-width ABI, only pointers need converting
+    .mmap = dev_mmap,
+    .poll = dev_poll,
 };
 
 static int __init simple_char_init(void) {
+    struct char_buffer *buf;
     dev_t dev_num;
     int regval;
 
@@ -126,20 +516,35 @@ static int __init simple_char_init(void) {
     printk(KERN_INFO "ioctl_char_dev: ioctl option MAX_SZ: %d", MAX_SZ);
     printk(KERN_INFO "ioctl_char_dev: ioctl option CUR_SZ: %d", CUR_SZ);
     printk(KERN_INFO "ioctl_char_dev: ioctl option INC_SZ: %d", INC_SZ);
+    printk(KERN_INFO "ioctl_char_dev: ioctl ABI version %d, batch option: %u", IOCTL_CHAR_ABI_VERSION, IOCTL_CHAR_BATCH);
+
+    if (size <= 0) {
+        return -EINVAL;
+    }
 
-    charArray = kmalloc(size * sizeof(char), GFP_KERNEL);
-    if (charArray == NULL) {
+    // Page-aligned and zeroed so it can be handed to userspace as is
+    buf = alloc_buffer(size);
+    if (buf == NULL) {
         return -ENOMEM;
     }
 
     for (int i = 0; i<size; i++) {
-        charArray[i]=' ';
+        buf->data[i]=' ';
     };
+    RCU_INIT_POINTER(cur_buf, buf);
+
+    stats = alloc_percpu(struct drv_stats);
+    if (stats == NULL) {
+        free_buffer(buf);
+        return -ENOMEM;
+    }
 
     regval = alloc_chrdev_region(&dev_num, 0, 1, DEVICE_NAME);
     
     if (regval < 0) {
         printk(KERN_ALERT "ioctl_char_dev: Memory allocation for major number failed\n");
+        free_percpu(stats);
+        free_buffer(buf);
         return regval;
     }
 
@@ -151,13 +556,17 @@ static int __init simple_char_init(void) {
     
     if (regval < 0) {
         printk(KERN_ALERT "ioctl_char_dev: Failed to load device\n");
+        unregister_chrdev_region(dev_num, 1);
+        free_percpu(stats);
+        free_buffer(buf);
         return regval;
     }
     
     else if (regval > 0) {
         printk(KERN_ALERT "returned value:%d\n", regval);
     }
-    
+
+    debug_dir = drv_stats_debugfs_create(DEVICE_NAME, stats);
     return 0;
 }
 
@@ -165,6 +574,10 @@ static void __exit simple_char_exit(void) {
     dev_t dev_num = MKDEV(major_num, 0);
     cdev_del(&le_cdev);
     unregister_chrdev_region(dev_num, 1);
+    srcu_barrier(&buffer_srcu); // Wait for buffers retired by resizes
+    free_buffer(rcu_dereference_protected(cur_buf, true));
+    debugfs_remove(debug_dir);
+    free_percpu(stats);
     printk(KERN_INFO "char_simp: Exited\n");
 }
 
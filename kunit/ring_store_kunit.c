@@ -0,0 +1,302 @@
+#include <kunit/test.h>
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/uio.h>
+
+#include "../pipe/circ_buf.h"
+#include "../simple_block/srd_store.h"
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("BiscuitBobby");
+MODULE_DESCRIPTION("KUnit tests for the pipe ring buffer and ramdisk I/O core");
+
+// --- circ_buf ---
+
+// Put len bytes of src through a kernel iov_iter. *left is what the ring did not take.
+static ssize_t ring_put(circular_buffer_t *cb, char *src, size_t len, size_t *left) {
+    struct kvec kv = { .iov_base = src, .iov_len = len };
+    struct iov_iter iter;
+    ssize_t ret;
+
+    iov_iter_kvec(&iter, ITER_SOURCE, &kv, 1, len);
+    ret = circular_buffer_put(cb, &iter);
+    if (left) {
+        *left = iov_iter_count(&iter);
+    }
+    return ret;
+}
+
+static ssize_t ring_get(circular_buffer_t *cb, char *dst, size_t len, size_t *left) {
+    struct kvec kv = { .iov_base = dst, .iov_len = len };
+    struct iov_iter iter;
+    ssize_t ret;
+
+    iov_iter_kvec(&iter, ITER_DEST, &kv, 1, len);
+    ret = circular_buffer_get(cb, &iter);
+    if (left) {
+        *left = iov_iter_count(&iter);
+    }
+    return ret;
+}
+
+static void fill_pattern(char *buf, size_t len, unsigned int seed) {
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = (char)(i * 31 + seed);
+    }
+}
+
+static int circ_buf_test_init(struct kunit *test) {
+    circular_buffer_t *cb = kunit_kzalloc(test, sizeof(*cb), GFP_KERNEL);
+
+    KUNIT_ASSERT_NOT_NULL(test, cb);
+    circular_buffer_init(cb);
+    test->priv = cb;
+    return 0;
+}
+
+// Head and tail both wrap at BUFFER_SIZE, and data crossing the end of the
+// array comes back in order
+static void circ_buf_test_wraparound(struct kunit *test) {
+    circular_buffer_t *cb = test->priv;
+    char *src = kunit_kmalloc(test, BUFFER_SIZE, GFP_KERNEL);
+    char *dst = kunit_kzalloc(test, BUFFER_SIZE, GFP_KERNEL);
+    size_t first = BUFFER_SIZE - 1000, second = 4000;
+
+    KUNIT_ASSERT_NOT_NULL(test, src);
+    KUNIT_ASSERT_NOT_NULL(test, dst);
+
+    fill_pattern(src, first, 1);
+    KUNIT_EXPECT_EQ(test, ring_put(cb, src, first, NULL), (ssize_t)first);
+    KUNIT_EXPECT_EQ(test, ring_get(cb, dst, first, NULL), (ssize_t)first);
+    KUNIT_EXPECT_EQ(test, cb->head, first);
+    KUNIT_EXPECT_EQ(test, cb->tail, first);
+    KUNIT_EXPECT_EQ(test, cb->count, 0);
+
+    fill_pattern(src, second, 2);
+    KUNIT_EXPECT_EQ(test, ring_put(cb, src, second, NULL), (ssize_t)second);
+    KUNIT_EXPECT_EQ(test, cb->head, (first + second) % BUFFER_SIZE);
+    KUNIT_EXPECT_EQ(test, cb->count, second);
+
+    KUNIT_EXPECT_EQ(test, ring_get(cb, dst, second, NULL), (ssize_t)second);
+    KUNIT_EXPECT_EQ(test, cb->tail, (first + second) % BUFFER_SIZE);
+    KUNIT_EXPECT_EQ(test, cb->count, 0);
+    KUNIT_EXPECT_MEMEQ(test, dst, src, second);
+}
+
+// A full ring takes nothing more and leaves the caller's iterator untouched
+static void circ_buf_test_full(struct kunit *test) {
+    circular_buffer_t *cb = test->priv;
+    char *src = kunit_kmalloc(test, BUFFER_SIZE + 100, GFP_KERNEL);
+    size_t left;
+
+    KUNIT_ASSERT_NOT_NULL(test, src);
+    fill_pattern(src, BUFFER_SIZE + 100, 3);
+
+    KUNIT_EXPECT_EQ(test, ring_put(cb, src, BUFFER_SIZE + 100, &left), (ssize_t)BUFFER_SIZE);
+    KUNIT_EXPECT_EQ(test, left, 100);
+    KUNIT_EXPECT_EQ(test, cb->count, BUFFER_SIZE);
+    KUNIT_EXPECT_EQ(test, cb->head, cb->tail);
+
+    KUNIT_EXPECT_EQ(test, ring_put(cb, src, 1, &left), 0);
+    KUNIT_EXPECT_EQ(test, left, 1);
+    KUNIT_EXPECT_EQ(test, cb->count, BUFFER_SIZE);
+}
+
+// An empty ring returns nothing, and a short ring returns only what it holds
+static void circ_buf_test_empty(struct kunit *test) {
+    circular_buffer_t *cb = test->priv;
+    char src[10], dst[20];
+    size_t left;
+
+    KUNIT_EXPECT_EQ(test, ring_get(cb, dst, sizeof(dst), &left), 0);
+    KUNIT_EXPECT_EQ(test, left, sizeof(dst));
+    KUNIT_EXPECT_EQ(test, cb->tail, 0);
+
+    fill_pattern(src, sizeof(src), 4);
+    KUNIT_EXPECT_EQ(test, ring_put(cb, src, sizeof(src), NULL), (ssize_t)sizeof(src));
+    KUNIT_EXPECT_EQ(test, ring_get(cb, dst, sizeof(dst), &left), (ssize_t)sizeof(src));
+    KUNIT_EXPECT_EQ(test, left, sizeof(dst) - sizeof(src));
+    KUNIT_EXPECT_MEMEQ(test, dst, src, sizeof(src));
+    KUNIT_EXPECT_EQ(test, cb->count, 0);
+}
+
+static struct kunit_case circ_buf_test_cases[] = {
+    KUNIT_CASE(circ_buf_test_wraparound),
+    KUNIT_CASE(circ_buf_test_full),
+    KUNIT_CASE(circ_buf_test_empty),
+    {}
+};
+
+static struct kunit_suite circ_buf_test_suite = {
+    .name = "circ_buf",
+    .init = circ_buf_test_init,
+    .test_cases = circ_buf_test_cases,
+};
+
+// --- srd_store ---
+
+#define SRD_TEST_PAGES 8
+#define SRD_TEST_SIZE (SRD_TEST_PAGES * PAGE_SIZE)
+
+static int srd_store_test_init(struct kunit *test) {
+    struct simple_ramdisk *dev = kunit_kzalloc(test, sizeof(*dev), GFP_KERNEL);
+
+    KUNIT_ASSERT_NOT_NULL(test, dev);
+    srd_init_store(dev, SRD_TEST_SIZE, true);
+    test->priv = dev;
+    return 0;
+}
+
+static void srd_store_test_exit(struct kunit *test) {
+    srd_free_pages(test->priv);
+}
+
+static bool all_bytes(const char *buf, size_t len, char c) {
+    for (size_t i = 0; i < len; i++) {
+        if (buf[i] != c) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Ranges that start past the end, run past the end, or overflow size_t are rejected
+static void srd_store_test_bounds(struct kunit *test) {
+    struct simple_ramdisk *dev = test->priv;
+    char *buf = kunit_kzalloc(test, 2 * PAGE_SIZE, GFP_KERNEL);
+
+    KUNIT_ASSERT_NOT_NULL(test, buf);
+
+    KUNIT_EXPECT_EQ(test, srd_do_io(dev, REQ_OP_READ, buf, SRD_TEST_SIZE - 512, 512), BLK_STS_OK);
+    KUNIT_EXPECT_EQ(test, srd_do_io(dev, REQ_OP_READ, buf, SRD_TEST_SIZE, 0), BLK_STS_OK);
+
+    KUNIT_EXPECT_EQ(test, srd_do_io(dev, REQ_OP_READ, buf, SRD_TEST_SIZE, 512), BLK_STS_IOERR);
+    KUNIT_EXPECT_EQ(test, srd_do_io(dev, REQ_OP_WRITE, buf, SRD_TEST_SIZE - 512, 1024), BLK_STS_IOERR);
+    KUNIT_EXPECT_EQ(test, srd_do_io(dev, REQ_OP_READ, buf, SRD_TEST_SIZE + PAGE_SIZE, 512), BLK_STS_IOERR);
+    KUNIT_EXPECT_EQ(test, srd_do_io(dev, REQ_OP_DISCARD, NULL, SRD_TEST_SIZE - 512, 1024), BLK_STS_IOERR);
+    // offset + len wraps around to a small number
+    KUNIT_EXPECT_EQ(test, srd_do_io(dev, REQ_OP_WRITE, buf, 512, SIZE_MAX), BLK_STS_IOERR);
+    KUNIT_EXPECT_EQ(test, srd_do_io(dev, REQ_OP_READ, buf, SIZE_MAX - 511, 1024), BLK_STS_IOERR);
+
+    // Rejected writes must not have allocated anything
+    KUNIT_EXPECT_EQ(test, dev->nr_pages, 0);
+}
+
+// Data written across a page boundary reads back intact
+static void srd_store_test_straddle(struct kunit *test) {
+    struct simple_ramdisk *dev = test->priv;
+    char *src = kunit_kmalloc(test, 2 * PAGE_SIZE, GFP_KERNEL);
+    char *dst = kunit_kzalloc(test, 2 * PAGE_SIZE, GFP_KERNEL);
+
+    KUNIT_ASSERT_NOT_NULL(test, src);
+    KUNIT_ASSERT_NOT_NULL(test, dst);
+    fill_pattern(src, 2 * PAGE_SIZE, 5);
+
+    KUNIT_EXPECT_EQ(test, srd_do_io(dev, REQ_OP_WRITE, src, PAGE_SIZE - 512, 1024), BLK_STS_OK);
+    KUNIT_EXPECT_EQ(test, dev->nr_pages, 2);
+    KUNIT_EXPECT_EQ(test, srd_do_io(dev, REQ_OP_READ, dst, PAGE_SIZE - 512, 1024), BLK_STS_OK);
+    KUNIT_EXPECT_MEMEQ(test, dst, src, 1024);
+}
+
+// Discarding whole pages releases them; neighbouring data is left alone
+static void srd_store_test_discard_whole(struct kunit *test) {
+    struct simple_ramdisk *dev = test->priv;
+    char *buf = kunit_kmalloc(test, 3 * PAGE_SIZE, GFP_KERNEL);
+
+    KUNIT_ASSERT_NOT_NULL(test, buf);
+    memset(buf, 0xa5, 3 * PAGE_SIZE);
+
+    KUNIT_ASSERT_EQ(test, srd_do_io(dev, REQ_OP_WRITE, buf, 0, 3 * PAGE_SIZE), BLK_STS_OK);
+    KUNIT_EXPECT_EQ(test, dev->nr_pages, 3);
+
+    KUNIT_EXPECT_EQ(test, srd_do_io(dev, REQ_OP_DISCARD, NULL, PAGE_SIZE, PAGE_SIZE), BLK_STS_OK);
+    KUNIT_EXPECT_EQ(test, dev->nr_pages, 2);
+
+    KUNIT_ASSERT_EQ(test, srd_do_io(dev, REQ_OP_READ, buf, 0, 3 * PAGE_SIZE), BLK_STS_OK);
+    KUNIT_EXPECT_TRUE(test, all_bytes(buf, PAGE_SIZE, (char)0xa5));
+    KUNIT_EXPECT_TRUE(test, all_bytes(buf + PAGE_SIZE, PAGE_SIZE, 0));
+    KUNIT_EXPECT_TRUE(test, all_bytes(buf + 2 * PAGE_SIZE, PAGE_SIZE, (char)0xa5));
+
+    // A range covering one whole page and parts of its neighbours frees only the whole one
+    memset(buf, 0xa5, 3 * PAGE_SIZE);
+    KUNIT_ASSERT_EQ(test, srd_do_io(dev, REQ_OP_WRITE, buf, 0, 3 * PAGE_SIZE), BLK_STS_OK);
+    KUNIT_EXPECT_EQ(test, dev->nr_pages, 3);
+    KUNIT_EXPECT_EQ(test, srd_do_io(dev, REQ_OP_WRITE_ZEROES, NULL, 512, 2 * PAGE_SIZE), BLK_STS_OK);
+    KUNIT_EXPECT_EQ(test, dev->nr_pages, 2);
+    KUNIT_ASSERT_EQ(test, srd_do_io(dev, REQ_OP_READ, buf, 0, 3 * PAGE_SIZE), BLK_STS_OK);
+    KUNIT_EXPECT_TRUE(test, all_bytes(buf, 512, (char)0xa5));
+    KUNIT_EXPECT_TRUE(test, all_bytes(buf + 512, 2 * PAGE_SIZE, 0));
+    KUNIT_EXPECT_TRUE(test, all_bytes(buf + 2 * PAGE_SIZE + 512, PAGE_SIZE - 512, (char)0xa5));
+}
+
+// Discarding part of a page zeroes the range in place. The page only becomes
+// a reclaim candidate once all of it is zero.
+static void srd_store_test_discard_partial(struct kunit *test) {
+    struct simple_ramdisk *dev = test->priv;
+    char *buf = kunit_kmalloc(test, PAGE_SIZE, GFP_KERNEL);
+
+    KUNIT_ASSERT_NOT_NULL(test, buf);
+    memset(buf, 0xa5, PAGE_SIZE);
+
+    KUNIT_ASSERT_EQ(test, srd_do_io(dev, REQ_OP_WRITE, buf, 0, PAGE_SIZE), BLK_STS_OK);
+    KUNIT_EXPECT_EQ(test, srd_do_io(dev, REQ_OP_DISCARD, NULL, 512, 1024), BLK_STS_OK);
+    KUNIT_EXPECT_EQ(test, dev->nr_pages, 1);
+    KUNIT_EXPECT_EQ(test, dev->nr_zero, 0);
+
+    KUNIT_ASSERT_EQ(test, srd_do_io(dev, REQ_OP_READ, buf, 0, PAGE_SIZE), BLK_STS_OK);
+    KUNIT_EXPECT_TRUE(test, all_bytes(buf, 512, (char)0xa5));
+    KUNIT_EXPECT_TRUE(test, all_bytes(buf + 512, 1024, 0));
+    KUNIT_EXPECT_TRUE(test, all_bytes(buf + 1536, PAGE_SIZE - 1536, (char)0xa5));
+
+    // Clearing the rest piecewise leaves an all-zero page tagged for the shrinker
+    KUNIT_EXPECT_EQ(test, srd_do_io(dev, REQ_OP_DISCARD, NULL, 0, 512), BLK_STS_OK);
+    KUNIT_EXPECT_EQ(test, dev->nr_zero, 0);
+    KUNIT_EXPECT_EQ(test, srd_do_io(dev, REQ_OP_DISCARD, NULL, 1536, PAGE_SIZE - 1536), BLK_STS_OK);
+    KUNIT_EXPECT_EQ(test, dev->nr_pages, 1);
+    KUNIT_EXPECT_EQ(test, dev->nr_zero, 1);
+
+    // New data clears the tag again
+    memset(buf, 0xa5, 512);
+    KUNIT_ASSERT_EQ(test, srd_do_io(dev, REQ_OP_WRITE, buf, 0, 512), BLK_STS_OK);
+    KUNIT_EXPECT_EQ(test, dev->nr_zero, 0);
+}
+
+// Writing a whole page of zeroes releases the backing page at once
+static void srd_store_test_zero_write(struct kunit *test) {
+    struct simple_ramdisk *dev = test->priv;
+    char *buf = kunit_kmalloc(test, PAGE_SIZE, GFP_KERNEL);
+
+    KUNIT_ASSERT_NOT_NULL(test, buf);
+
+    memset(buf, 0, PAGE_SIZE);
+    KUNIT_EXPECT_EQ(test, srd_do_io(dev, REQ_OP_WRITE, buf, 0, PAGE_SIZE), BLK_STS_OK);
+    KUNIT_EXPECT_EQ(test, dev->nr_pages, 0);
+
+    memset(buf, 0xa5, PAGE_SIZE);
+    KUNIT_ASSERT_EQ(test, srd_do_io(dev, REQ_OP_WRITE, buf, 0, PAGE_SIZE), BLK_STS_OK);
+    KUNIT_EXPECT_EQ(test, dev->nr_pages, 1);
+
+    memset(buf, 0, PAGE_SIZE);
+    KUNIT_EXPECT_EQ(test, srd_do_io(dev, REQ_OP_WRITE, buf, 0, PAGE_SIZE), BLK_STS_OK);
+    KUNIT_EXPECT_EQ(test, dev->nr_pages, 0);
+    KUNIT_EXPECT_EQ(test, dev->nr_zero, 0);
+}
+
+static struct kunit_case srd_store_test_cases[] = {
+    KUNIT_CASE(srd_store_test_bounds),
+    KUNIT_CASE(srd_store_test_straddle),
+    KUNIT_CASE(srd_store_test_discard_whole),
+    KUNIT_CASE(srd_store_test_discard_partial),
+    KUNIT_CASE(srd_store_test_zero_write),
+    {}
+};
+
+static struct kunit_suite srd_store_test_suite = {
+    .name = "srd_store",
+    .init = srd_store_test_init,
+    .exit = srd_store_test_exit,
+    .test_cases = srd_store_test_cases,
+};
+
+kunit_test_suites(&circ_buf_test_suite, &srd_store_test_suite);
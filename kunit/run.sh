@@ -0,0 +1,24 @@
+#!/bin/sh
+# Run the KUnit suites with kunit.py, which only builds tests that are part
+# of the kernel tree. The repository is linked in as drivers/kernel_drivers
+# and hooked into drivers/Kconfig and drivers/Makefile (once; the edits are
+# idempotent), then kunit.py builds a UML kernel from kunit/.kunitconfig.
+#
+#   kunit/run.sh KERNEL_TREE [kunit.py run options, e.g. --arch=x86_64]
+set -eu
+
+REPO=$(cd "$(dirname "$0")/.." && pwd)
+KERNEL_TREE=$(cd "$1" && pwd)
+shift
+
+ln -sfn "$REPO" "$KERNEL_TREE/drivers/kernel_drivers"
+if ! grep -q 'drivers/kernel_drivers/kunit/Kconfig' "$KERNEL_TREE/drivers/Kconfig"; then
+    # drivers/Kconfig ends with the endmenu of the "Device Drivers" menu
+    sed -i '$i source "drivers/kernel_drivers/kunit/Kconfig"' "$KERNEL_TREE/drivers/Kconfig"
+fi
+if ! grep -q 'kernel_drivers/kunit/' "$KERNEL_TREE/drivers/Makefile"; then
+    echo 'obj-$(CONFIG_KERNEL_DRIVERS_KUNIT_TEST) += kernel_drivers/kunit/' >> "$KERNEL_TREE/drivers/Makefile"
+fi
+
+cd "$KERNEL_TREE"
+./tools/testing/kunit/kunit.py run --kunitconfig=drivers/kernel_drivers/kunit "$@"
@@ -0,0 +1,236 @@
+#ifndef BCAST_BUF_H
+#define BCAST_BUF_H
+
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/uio.h>
+#include <linux/wait.h>
+
+#include "circ_buf.h"
+
+// Broadcast ("tee") variant of the ring: every byte is written once and each
+// reader consumes it through its own cursor. Positions are absolute stream
+// offsets, so a reader's backlog is head - tail and the ring only frees space
+// once the slowest reader has moved past it.
+
+// What a writer does when the slowest reader leaves no room
+enum bcast_policy {
+    BCAST_BLOCK = 0, // Sleep until the slowest reader catches up
+    BCAST_DROP = 1,  // Skip the slow reader past the overwritten data
+    BCAST_MARK = 2,  // As BCAST_DROP, and fail its next read with -EOVERFLOW
+};
+
+struct bcast_reader {
+    struct list_head node;
+    u64 tail;    // Stream position of the next byte this reader returns
+    bool lagged; // Data was dropped since the last read (BCAST_MARK only)
+};
+
+typedef struct {
+    char buffer[BUFFER_SIZE];
+    u64 head;                 // Stream position of the next byte written
+    u64 tail;                 // Cursor of the slowest reader, head when there are none
+    struct list_head readers; // Open readers, each with its own cursor
+    unsigned int nr_readers;
+    enum bcast_policy policy;
+    u64 dropped_bytes;        // Bytes skipped past slow readers, summed over readers
+    u64 lag_events;           // Times a reader was skipped ahead
+    struct mutex lock;        // Protects everything above and the readers' cursors
+    wait_queue_head_t read_queue;
+    wait_queue_head_t write_queue;
+} broadcast_buffer_t;
+
+static inline void broadcast_buffer_init(broadcast_buffer_t *bb, enum bcast_policy policy) {
+    bb->head = 0;
+    bb->tail = 0;
+    INIT_LIST_HEAD(&bb->readers);
+    bb->nr_readers = 0;
+    bb->policy = policy;
+    bb->dropped_bytes = 0;
+    bb->lag_events = 0;
+    mutex_init(&bb->lock);
+    init_waitqueue_head(&bb->read_queue);
+    init_waitqueue_head(&bb->write_queue);
+}
+
+// Recompute the slowest cursor. Caller holds bb->lock.
+static inline void broadcast_buffer_update_tail(broadcast_buffer_t *bb) {
+    struct bcast_reader *r;
+    u64 oldest = bb->head;
+
+    list_for_each_entry(r, &bb->readers, node) {
+        oldest = min(oldest, r->tail);
+    }
+    WRITE_ONCE(bb->tail, oldest);
+}
+
+// Free space in the ring, as limited by the slowest reader. Safe to call
+// without bb->lock as a wakeup condition.
+static inline size_t broadcast_buffer_space(broadcast_buffer_t *bb) {
+    return BUFFER_SIZE - (READ_ONCE(bb->head) - READ_ONCE(bb->tail));
+}
+
+// New readers start at the live end of the stream
+static inline void broadcast_buffer_add_reader(broadcast_buffer_t *bb, struct bcast_reader *r) {
+    mutex_lock(&bb->lock);
+    r->tail = bb->head;
+    r->lagged = false;
+    list_add_tail(&r->node, &bb->readers);
+    bb->nr_readers++;
+    mutex_unlock(&bb->lock);
+}
+
+static inline void broadcast_buffer_del_reader(broadcast_buffer_t *bb, struct bcast_reader *r) {
+    mutex_lock(&bb->lock);
+    list_del(&r->node);
+    bb->nr_readers--;
+    broadcast_buffer_update_tail(bb);
+    mutex_unlock(&bb->lock);
+    // The slowest reader may just have gone away
+    wake_up_interruptible(&bb->write_queue);
+}
+
+// Move every reader that would be overrun by the next len bytes up to the
+// oldest byte that survives them. Caller holds bb->lock.
+static inline void broadcast_buffer_drop(broadcast_buffer_t *bb, size_t len) {
+    struct bcast_reader *r;
+    u64 keep_from;
+
+    len = min_t(size_t, len, BUFFER_SIZE);
+    if (bb->head + len <= BUFFER_SIZE) {
+        return;
+    }
+    keep_from = bb->head + len - BUFFER_SIZE;
+
+    list_for_each_entry(r, &bb->readers, node) {
+        if (r->tail < keep_from) {
+            bb->dropped_bytes += keep_from - r->tail;
+            bb->lag_events++;
+            WRITE_ONCE(r->tail, keep_from);
+            r->lagged = bb->policy == BCAST_MARK;
+        }
+    }
+    broadcast_buffer_update_tail(bb);
+}
+
+// Copy as much of from as the slowest reader leaves room for, in at most two
+// contiguous chunks. Returns the number of bytes stored, or -EFAULT if
+// nothing could be copied. Caller holds bb->lock.
+static inline ssize_t broadcast_buffer_put(broadcast_buffer_t *bb, struct iov_iter *from) {
+    size_t space = broadcast_buffer_space(bb);
+    size_t done = 0;
+
+    while (space > 0 && iov_iter_count(from) > 0) {
+        size_t off = bb->head % BUFFER_SIZE;
+        size_t chunk = min3(iov_iter_count(from), space, BUFFER_SIZE - off);
+        size_t copied = copy_from_iter(&bb->buffer[off], chunk, from);
+
+        WRITE_ONCE(bb->head, bb->head + copied);
+        space -= copied;
+        done += copied;
+        if (copied < chunk) {
+            break;
+        }
+    }
+    // Nobody to wait for, so the data is gone as soon as it is written
+    if (list_empty(&bb->readers)) {
+        WRITE_ONCE(bb->tail, bb->head);
+    }
+
+    return (done == 0 && iov_iter_count(from) > 0 && space > 0) ? -EFAULT : done;
+}
+
+// Copy the reader's unread data into to, in at most two contiguous chunks.
+// Returns the number of bytes consumed, or -EFAULT if nothing could be
+// copied. Caller holds bb->lock.
+static inline ssize_t broadcast_buffer_get(broadcast_buffer_t *bb, struct bcast_reader *r,
+                                           struct iov_iter *to) {
+    bool was_slowest = r->tail == bb->tail;
+    size_t done = 0;
+
+    while (bb->head > r->tail && iov_iter_count(to) > 0) {
+        size_t off = r->tail % BUFFER_SIZE;
+        size_t chunk = min3(iov_iter_count(to), (size_t)(bb->head - r->tail), BUFFER_SIZE - off);
+        size_t copied = copy_to_iter(&bb->buffer[off], chunk, to);
+
+        WRITE_ONCE(r->tail, r->tail + copied);
+        done += copied;
+        if (copied < chunk) {
+            break;
+        }
+    }
+    if (was_slowest && done > 0) {
+        broadcast_buffer_update_tail(bb);
+    }
+
+    return (done == 0 && iov_iter_count(to) > 0 && bb->head > r->tail) ? -EFAULT : done;
+}
+
+// Store all of from. Under BCAST_BLOCK this sleeps while the slowest reader
+// holds the ring full; otherwise slow readers lose their oldest data instead.
+static inline ssize_t broadcast_buffer_write(broadcast_buffer_t *bb, struct iov_iter *from,
+                                             struct circ_wait_info *info) {
+    size_t written = 0;
+    ssize_t copied;
+
+    while (iov_iter_count(from) > 0) {
+        if (bb->policy == BCAST_BLOCK &&
+            circ_wait_event(bb->write_queue, broadcast_buffer_space(bb) > 0, info)) {
+            return written ? written : -ERESTARTSYS;
+        }
+
+        mutex_lock(&bb->lock);
+        if (bb->policy != BCAST_BLOCK) {
+            broadcast_buffer_drop(bb, iov_iter_count(from));
+        }
+        copied = broadcast_buffer_put(bb, from);
+        mutex_unlock(&bb->lock);
+
+        if (copied < 0) {
+            return written ? written : copied;
+        }
+        written += copied;
+
+        wake_up_interruptible(&bb->read_queue);
+    }
+
+    return written;
+}
+
+// Fill all of to from the reader's cursor, sleeping while it has caught up
+// with the writer. A reader that was skipped ahead under BCAST_MARK gets a
+// short read, then -EOVERFLOW once, and carries on from the surviving data.
+static inline ssize_t broadcast_buffer_read(broadcast_buffer_t *bb, struct bcast_reader *r,
+                                            struct iov_iter *to, struct circ_wait_info *info) {
+    size_t read = 0;
+    ssize_t copied;
+
+    while (iov_iter_count(to) > 0) {
+        if (circ_wait_event(bb->read_queue, READ_ONCE(bb->head) != READ_ONCE(r->tail), info)) {
+            return read ? read : -ERESTARTSYS;
+        }
+
+        mutex_lock(&bb->lock);
+        if (r->lagged) {
+            if (read == 0) {
+                r->lagged = false;
+            }
+            mutex_unlock(&bb->lock);
+            return read ? read : -EOVERFLOW;
+        }
+        copied = broadcast_buffer_get(bb, r, to);
+        mutex_unlock(&bb->lock);
+
+        if (copied < 0) {
+            return read ? read : copied;
+        }
+        read += copied;
+
+        wake_up_interruptible(&bb->write_queue);
+    }
+
+    return read;
+}
+
+#endif
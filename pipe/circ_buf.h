@@ -0,0 +1,151 @@
+#ifndef CIRC_BUF_H
+#define CIRC_BUF_H
+
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/mutex.h>
+#include <linux/uio.h>
+#include <linux/wait.h>
+
+#define BUFFER_SIZE 8192
+
+// Ring buffer core shared by the pipe driver and bench/kmicro. Data moves
+// through iov_iters, so the same code serves user buffers from read()/write()
+// and kernel buffers (ITER_KVEC) from in-kernel callers.
+typedef struct {
+    char buffer[BUFFER_SIZE];
+    size_t head;
+    size_t tail;
+    size_t count;
+    struct mutex lock; // Protects head, tail, count and the buffer contents
+    wait_queue_head_t read_queue;
+    wait_queue_head_t write_queue;
+} circular_buffer_t;
+
+// How long a blocking read or write slept, filled in when the caller asks for it
+struct circ_wait_info {
+    unsigned int waits;
+    u64 blocked_ns;
+};
+
+// Sleep on wq until cond holds, timing the sleep into info (may be NULL).
+// Evaluates to -ERESTARTSYS if interrupted.
+#define circ_wait_event(wq, cond, info) ({                                  \
+    int __ret = 0;                                                          \
+    if (!(cond)) {                                                          \
+        u64 __start = ktime_get_ns();                                       \
+        __ret = wait_event_interruptible(wq, cond);                         \
+        if (info) {                                                         \
+            (info)->waits++;                                                \
+            (info)->blocked_ns += ktime_get_ns() - __start;                 \
+        }                                                                   \
+    }                                                                       \
+    __ret;                                                                  \
+})
+
+static inline void circular_buffer_init(circular_buffer_t *cb) {
+    cb->head = 0;
+    cb->tail = 0;
+    cb->count = 0;
+    mutex_init(&cb->lock);
+    init_waitqueue_head(&cb->read_queue);
+    init_waitqueue_head(&cb->write_queue);
+}
+
+// Copy as much of from as fits, in at most two contiguous chunks. Returns the
+// number of bytes stored, or -EFAULT if nothing could be copied.
+// Caller holds cb->lock.
+static inline ssize_t circular_buffer_put(circular_buffer_t *cb, struct iov_iter *from) {
+    size_t done = 0;
+
+    while (cb->count < BUFFER_SIZE && iov_iter_count(from) > 0) {
+        size_t chunk = min3(iov_iter_count(from), BUFFER_SIZE - cb->count, BUFFER_SIZE - cb->head);
+        size_t copied = copy_from_iter(&cb->buffer[cb->head], chunk, from);
+
+        cb->head = (cb->head + copied) % BUFFER_SIZE;
+        cb->count += copied;
+        done += copied;
+        if (copied < chunk) {
+            return done ? done : -EFAULT;
+        }
+    }
+
+    return done;
+}
+
+// Copy as much buffered data into to as it has room for, in at most two
+// contiguous chunks. Returns the number of bytes removed, or -EFAULT if
+// nothing could be copied. Caller holds cb->lock.
+static inline ssize_t circular_buffer_get(circular_buffer_t *cb, struct iov_iter *to) {
+    size_t done = 0;
+
+    while (cb->count > 0 && iov_iter_count(to) > 0) {
+        size_t chunk = min3(iov_iter_count(to), cb->count, BUFFER_SIZE - cb->tail);
+        size_t copied = copy_to_iter(&cb->buffer[cb->tail], chunk, to);
+
+        cb->tail = (cb->tail + copied) % BUFFER_SIZE;
+        cb->count -= copied;
+        done += copied;
+        if (copied < chunk) {
+            return done ? done : -EFAULT;
+        }
+    }
+
+    return done;
+}
+
+// Store all of from, sleeping while the ring is full. A signal or fault
+// after some bytes were stored ends in a short write rather than an error.
+static inline ssize_t circular_buffer_write(circular_buffer_t *cb, struct iov_iter *from,
+                                            struct circ_wait_info *info) {
+    size_t written = 0;
+    ssize_t copied;
+
+    while (iov_iter_count(from) > 0) {
+        if (circ_wait_event(cb->write_queue, READ_ONCE(cb->count) < BUFFER_SIZE, info)) {
+            return written ? written : -ERESTARTSYS;
+        }
+
+        mutex_lock(&cb->lock);
+        copied = circular_buffer_put(cb, from);
+        mutex_unlock(&cb->lock);
+
+        if (copied < 0) {
+            return written ? written : copied;
+        }
+        written += copied;
+
+        wake_up_interruptible(&cb->read_queue);
+    }
+
+    return written;
+}
+
+// Fill all of to, sleeping while the ring is empty. Bytes already taken
+// out of the ring are returned even if a signal or fault follows.
+static inline ssize_t circular_buffer_read(circular_buffer_t *cb, struct iov_iter *to,
+                                           struct circ_wait_info *info) {
+    size_t read = 0;
+    ssize_t copied;
+
+    while (iov_iter_count(to) > 0) {
+        if (circ_wait_event(cb->read_queue, READ_ONCE(cb->count) > 0, info)) {
+            return read ? read : -ERESTARTSYS;
+        }
+
+        mutex_lock(&cb->lock);
+        copied = circular_buffer_get(cb, to);
+        mutex_unlock(&cb->lock);
+
+        if (copied < 0) {
+            return read ? read : copied;
+        }
+        read += copied;
+
+        wake_up_interruptible(&cb->write_queue);
+    }
+
+    return read;
+}
+
+#endif
@@ -4,9 +4,17 @@
 #include <linux/cdev.h>
 #include <linux/uaccess.h>
 #include <linux/slab.h>
+#include <linux/uio.h>
+
+#include "circ_buf.h"
+#include "bcast_buf.h"
+#include "spill_buf.h"
+#include "../common/drv_stats.h"
+
+#define CREATE_TRACE_POINTS
+#include "pipe_trace.h"
 
 #define DEVICE_NAME "char_pipe_dev"
-#define BUFFER_SIZE 8192
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("BiscuitBobby");
@@ -15,94 +23,90 @@ MODULE_DESCRIPTION("Circular buffer pipe driver");
 static int major_num;
 static struct cdev le_cdev;
 
-typedef struct {
-    char buffer[BUFFER_SIZE];
-    size_t head;
-    size_t tail;
-    size_t count;
-    wait_queue_head_t read_queue;
-    wait_queue_head_t write_queue;
-} circular_buffer_t;
-
 static circular_buffer_t cb;
+static broadcast_buffer_t bb;
+static bool broadcast = false;
+static int slow_reader = BCAST_BLOCK;
+static spill_buffer_t sp;
+static bool spilling;     // Set when spill_path is given
+static char *spill_path;
+static unsigned long spill_limit = 1UL << 30;
+static struct drv_stats __percpu *stats; // Exposed in /sys/kernel/debug/char_pipe_dev/stats
+static struct dentry *debug_dir;
+
+module_param(broadcast, bool, 0444);
+MODULE_PARM_DESC(broadcast, "Deliver every write to every open reader instead of to one of them (default: false)");
+module_param(slow_reader, int, 0444);
+MODULE_PARM_DESC(slow_reader, "Broadcast mode, when the slowest reader fills the ring: "
+                 "0 = block the writer, 1 = drop its oldest data, 2 = drop and fail its next read with EOVERFLOW (default: 0)");
+module_param(spill_path, charp, 0444);
+MODULE_PARM_DESC(spill_path, "File to spill writes to while the ring is full instead of blocking the writer (default: none)");
+module_param(spill_limit, ulong, 0444);
+MODULE_PARM_DESC(spill_limit, "Most bytes held in the spill file before writers block (default: 1 GiB)");
 
-static void circular_buffer_init(circular_buffer_t *cb) {
-    cb->count = 0;
-    init_waitqueue_head(&cb->read_queue);
-    init_waitqueue_head(&cb->write_queue);
-}
-
-static ssize_t circular_buffer_write(circular_buffer_t *cb, const char *user_buffer, size_t count) {
-    size_t written = 0;
-
-    while (written < count) {
-        while (cb->count == BUFFER_SIZE) {
-            if (wait_event_interruptible(cb->write_queue, cb->count < BUFFER_SIZE)) {
-                return -ERESTARTSYS;
-            }
-        }
-
-        if (copy_from_user(&cb->buffer[cb->head], &user_buffer[written], 1)) {
-            return -EFAULT;
-        }
-        cb->head = (cb->head + 1) % BUFFER_SIZE;
-        cb->count++;
-        written++;
-
-        wake_up_interruptible(&cb->read_queue);
-    }
-
-    return written;
-}
-
-static ssize_t circular_buffer_read(circular_buffer_t *cb, char *user_buffer, size_t count) {
-    size_t read = 0;
-
-    while (read < count) {
-        while (cb->count == 0) {
-            if (wait_event_interruptible(cb->read_queue, cb->count > 0)) {
-                return -ERESTARTSYS;
-            }
-        }
+static int simple_char_open(struct inode *inode, struct file *instance) {
+    // In broadcast mode each reader gets its own cursor into the shared ring.
+    // O_RDWR opens count as readers too, and hold the writer back if they never read.
+    if (broadcast && (instance->f_mode & FMODE_READ)) {
+        struct bcast_reader *r = kzalloc(sizeof(*r), GFP_KERNEL);
 
-        if (copy_to_user(&user_buffer[read], &cb->buffer[cb->tail], 1)) {
-            return -EFAULT;
+        if (r == NULL) {
+            return -ENOMEM;
         }
-        cb->tail = (cb->tail + 1) % BUFFER_SIZE;
-        cb->count--;
-        read++;
-
-        wake_up_interruptible(&cb->write_queue);
+        broadcast_buffer_add_reader(&bb, r);
+        instance->private_data = r;
     }
-
-    return read;
-}
-
-static int simple_char_open(struct inode *inode, struct file *instance) {
-    printk(KERN_INFO "char_pipe_dev: opened device\n");
+    this_cpu_inc(stats->opens);
+    trace_char_pipe_open(instance->f_flags);
     return 0;
 }
 
-ssize_t dev_read(struct file *FILE, char *user_buffer, size_t count, loff_t *offset) {
-    ssize_t result = circular_buffer_read(&cb, user_buffer, count);
-    if (result < 0) {
-        return result;
+static ssize_t dev_read_iter(struct kiocb *iocb, struct iov_iter *to) {
+    struct circ_wait_info wait = { 0 };
+    size_t requested = iov_iter_count(to);
+    u64 start = trace_char_pipe_io_enabled() ? ktime_get_ns() : 0;
+    ssize_t result;
+
+    if (broadcast) {
+        result = broadcast_buffer_read(&bb, iocb->ki_filp->private_data, to, &wait);
+    } else if (spilling) {
+        result = spill_buffer_read(&sp, to, &wait);
+    } else {
+        result = circular_buffer_read(&cb, to, &wait);
     }
-    printk(KERN_INFO "char_pipe_dev: read %zu bytes\n", result);
+
+    this_cpu_add(stats->blocked_waits, wait.waits);
+    drv_stats_io(stats, false, result);
+    trace_char_pipe_io(false, requested, result, start ? ktime_get_ns() - start : 0, wait.blocked_ns);
     return result;
 }
 
-ssize_t dev_write(struct file *File, const char *user_buffer, size_t count, loff_t *offset){
-    ssize_t result = circular_buffer_write(&cb, user_buffer, count);
-    if (result < 0) {
-        return result;
+static ssize_t dev_write_iter(struct kiocb *iocb, struct iov_iter *from) {
+    struct circ_wait_info wait = { 0 };
+    size_t requested = iov_iter_count(from);
+    u64 start = trace_char_pipe_io_enabled() ? ktime_get_ns() : 0;
+    ssize_t result;
+
+    if (broadcast) {
+        result = broadcast_buffer_write(&bb, from, &wait);
+    } else if (spilling) {
+        result = spill_buffer_write(&sp, from, &wait);
+    } else {
+        result = circular_buffer_write(&cb, from, &wait);
     }
-    printk(KERN_INFO "char_pipe_dev: written %zu bytes\n", result);
+
+    this_cpu_add(stats->blocked_waits, wait.waits);
+    drv_stats_io(stats, true, result);
+    trace_char_pipe_io(true, requested, result, start ? ktime_get_ns() - start : 0, wait.blocked_ns);
     return result;
 }
 
 static int simple_char_release(struct inode *inode, struct file *instance) {
-    printk(KERN_INFO "char_pipe_dev: driver closed\n");
+    if (instance->private_data) {
+        broadcast_buffer_del_reader(&bb, instance->private_data);
+        kfree(instance->private_data);
+    }
+    trace_char_pipe_release(instance->f_flags);
     return 0;
 }
 
@@ -110,8 +114,8 @@ static const struct file_operations fops = {
     .owner = THIS_MODULE,
     .open = simple_char_open,
     .release = simple_char_release,
-    .read = dev_read,
-    .write = dev_write,
+    .read_iter = dev_read_iter,
+    .write_iter = dev_write_iter,
 };
 
 static int __init simple_char_init(void) {
@@ -119,12 +123,41 @@ static int __init simple_char_init(void) {
     int regval;
 
     printk(KERN_INFO "char_pipe_dev: Initializing device\n");
+    if (slow_reader < BCAST_BLOCK || slow_reader > BCAST_MARK) {
+        return -EINVAL;
+    }
     circular_buffer_init(&cb);
+    broadcast_buffer_init(&bb, slow_reader);
+
+    spilling = spill_path != NULL && *spill_path != '\0';
+    if (spilling) {
+        // A broadcast ring cannot be replayed from one shared spill file
+        if (broadcast || spill_limit == 0) {
+            return -EINVAL;
+        }
+        regval = spill_buffer_init(&sp, &cb, spill_path, spill_limit);
+        if (regval < 0) {
+            printk(KERN_ALERT "char_pipe_dev: Cannot open spill file %s: %d\n", spill_path, regval);
+            return regval;
+        }
+    }
+
+    stats = alloc_percpu(struct drv_stats);
+    if (stats == NULL) {
+        if (spilling) {
+            spill_buffer_destroy(&sp);
+        }
+        return -ENOMEM;
+    }
 
     regval = alloc_chrdev_region(&dev_num, 0, 1, DEVICE_NAME);
     
     if (regval < 0) {
         printk(KERN_ALERT "char_pipe_dev: Memory allocation for major number failed\n");
+        free_percpu(stats);
+        if (spilling) {
+            spill_buffer_destroy(&sp);
+        }
         return regval;
     }
 
@@ -136,9 +169,27 @@ static int __init simple_char_init(void) {
     
     if (regval < 0) {
         printk(KERN_ALERT "char_pipe_dev: Failed to load device\n");
+        unregister_chrdev_region(dev_num, 1);
+        free_percpu(stats);
+        if (spilling) {
+            spill_buffer_destroy(&sp);
+        }
         return regval;
     }
-    
+
+    debug_dir = drv_stats_debugfs_create(DEVICE_NAME, stats);
+    if (broadcast) {
+        debugfs_create_u32("readers", 0444, debug_dir, &bb.nr_readers);
+        debugfs_create_u64("dropped_bytes", 0444, debug_dir, &bb.dropped_bytes);
+        debugfs_create_u64("lag_events", 0444, debug_dir, &bb.lag_events);
+    }
+    if (spilling) {
+        debugfs_create_u64("spilled_bytes", 0444, debug_dir, &sp.spilled_bytes);
+        debugfs_create_u64("unspilled_bytes", 0444, debug_dir, &sp.unspilled_bytes);
+        debugfs_create_u64("spill_file_writes", 0444, debug_dir, &sp.file_writes);
+        debugfs_create_u64("spill_file_write_ns", 0444, debug_dir, &sp.file_write_ns);
+        debugfs_create_u64("spill_file_write_max_ns", 0444, debug_dir, &sp.file_write_max_ns);
+    }
     return 0;
 }
 
@@ -146,6 +197,11 @@ static void __exit simple_char_exit(void) {
     dev_t dev_num = MKDEV(major_num, 0);
     cdev_del(&le_cdev);
     unregister_chrdev_region(dev_num, 1);
+    debugfs_remove(debug_dir);
+    free_percpu(stats);
+    if (spilling) {
+        spill_buffer_destroy(&sp);
+    }
     printk(KERN_INFO "char_pipe: Exited\n");
 }
 
@@ -0,0 +1,321 @@
+#ifndef SPILL_BUF_H
+#define SPILL_BUF_H
+
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/uio.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+
+#include "circ_buf.h"
+
+// Overflow mode for the pipe ring. Once the ring is full, writes are staged
+// in memory and a worker appends them to a backing file, so producers only
+// wait for a page copy rather than for the consumer. The stream order is
+// ring, then file, then staging: while anything is spilled new writes go to
+// the spill too, and readers finish the ring, then read the file back in
+// order before the ring is used again.
+
+struct spill_chunk {
+    struct list_head node;
+    size_t len;
+    bool busy;   // Taken by the worker, no longer appendable
+    char data[];
+};
+
+#define SPILL_CHUNK_DATA (PAGE_SIZE - sizeof(struct spill_chunk))
+#define SPILL_STAGE_MAX (64 * PAGE_SIZE) // Writers wait once this much is staged
+
+typedef struct {
+    circular_buffer_t *cb;       // The ring being overflowed; cb->lock protects the fields below
+    struct file *filp;
+    struct workqueue_struct *wq; // Ordered, so chunks hit the file in sequence
+    struct work_struct work;
+    struct list_head staged;     // Chunks not yet written out, oldest first
+    size_t staged_bytes;
+    loff_t write_pos;            // End of the data in the file
+    loff_t read_pos;             // Start of the data not yet read back
+    u64 limit;                   // Most bytes held in the file and staging together
+    int error;                   // First failed file write; the spill stops there
+    struct mutex read_lock;      // Serializes readers of the file and bounce
+    char *bounce;                // Readers copy file data through this page
+
+    // Exposed through debugfs, updated under cb->lock
+    u64 spilled_bytes;           // Bytes written into the spill
+    u64 unspilled_bytes;         // Bytes read back out of the file
+    u64 file_writes;
+    u64 file_write_ns;           // Total time the worker spent in kernel_write()
+    u64 file_write_max_ns;
+} spill_buffer_t;
+
+// Bytes held by the spill, whether already in the file or still staged.
+// Safe to call without cb->lock as a wakeup condition.
+static inline u64 spill_pending(spill_buffer_t *sp) {
+    return READ_ONCE(sp->staged_bytes) + (READ_ONCE(sp->write_pos) - READ_ONCE(sp->read_pos));
+}
+
+static inline bool spill_readable(spill_buffer_t *sp) {
+    return READ_ONCE(sp->write_pos) != READ_ONCE(sp->read_pos) || READ_ONCE(sp->error);
+}
+
+static inline bool spill_has_room(spill_buffer_t *sp) {
+    return (READ_ONCE(sp->staged_bytes) < SPILL_STAGE_MAX && spill_pending(sp) < sp->limit) ||
+           READ_ONCE(sp->error);
+}
+
+// Write staged chunks to the file until none are left
+static void spill_work_fn(struct work_struct *work) {
+    spill_buffer_t *sp = container_of(work, spill_buffer_t, work);
+    circular_buffer_t *cb = sp->cb;
+
+    for (;;) {
+        struct spill_chunk *chunk;
+        loff_t pos;
+        ssize_t ret;
+        u64 start, elapsed;
+
+        mutex_lock(&cb->lock);
+        chunk = list_first_entry_or_null(&sp->staged, struct spill_chunk, node);
+        if (chunk == NULL || sp->error) {
+            mutex_unlock(&cb->lock);
+            return;
+        }
+        chunk->busy = true;
+        pos = sp->write_pos;
+        mutex_unlock(&cb->lock);
+
+        start = ktime_get_ns();
+        ret = kernel_write(sp->filp, chunk->data, chunk->len, &pos);
+        elapsed = ktime_get_ns() - start;
+
+        mutex_lock(&cb->lock);
+        if (ret != chunk->len) {
+            // Leave the chunk queued; everything after it is stuck behind it
+            WRITE_ONCE(sp->error, ret < 0 ? (int)ret : -EIO);
+            chunk = NULL;
+        } else {
+            list_del(&chunk->node);
+            WRITE_ONCE(sp->staged_bytes, sp->staged_bytes - chunk->len);
+            WRITE_ONCE(sp->write_pos, pos);
+            sp->file_writes++;
+            sp->file_write_ns += elapsed;
+            sp->file_write_max_ns = max(sp->file_write_max_ns, elapsed);
+        }
+        mutex_unlock(&cb->lock);
+
+        if (chunk == NULL) {
+            pr_warn_ratelimited("char_pipe_dev: spill write failed: %d\n", READ_ONCE(sp->error));
+        }
+        kfree(chunk);
+        wake_up_interruptible(&cb->read_queue);
+        wake_up_interruptible(&cb->write_queue);
+    }
+}
+
+// Open the backing file and start the worker. The file is truncated: spilled
+// data does not outlive the module.
+static inline int spill_buffer_init(spill_buffer_t *sp, circular_buffer_t *cb, const char *path, u64 limit) {
+    memset(sp, 0, sizeof(*sp));
+    sp->cb = cb;
+    sp->limit = limit;
+    INIT_LIST_HEAD(&sp->staged);
+    INIT_WORK(&sp->work, spill_work_fn);
+    mutex_init(&sp->read_lock);
+
+    sp->bounce = (char *)__get_free_page(GFP_KERNEL);
+    if (sp->bounce == NULL) {
+        return -ENOMEM;
+    }
+    sp->wq = alloc_ordered_workqueue("char_pipe_spill", 0);
+    if (sp->wq == NULL) {
+        free_page((unsigned long)sp->bounce);
+        return -ENOMEM;
+    }
+    sp->filp = filp_open(path, O_RDWR | O_CREAT | O_TRUNC | O_LARGEFILE, 0600);
+    if (IS_ERR(sp->filp)) {
+        int ret = PTR_ERR(sp->filp);
+
+        destroy_workqueue(sp->wq);
+        free_page((unsigned long)sp->bounce);
+        return ret;
+    }
+
+    return 0;
+}
+
+// Stop the worker and drop whatever is still spilled
+static inline void spill_buffer_destroy(spill_buffer_t *sp) {
+    struct spill_chunk *chunk, *next;
+
+    destroy_workqueue(sp->wq);
+    list_for_each_entry_safe(chunk, next, &sp->staged, node) {
+        kfree(chunk);
+    }
+    filp_close(sp->filp, NULL);
+    free_page((unsigned long)sp->bounce);
+}
+
+// Stage as much of from as the spill has room for and kick the worker.
+// Returns the number of bytes staged, or a negative error if none were.
+// Caller holds cb->lock.
+static inline ssize_t spill_buffer_put(spill_buffer_t *sp, struct iov_iter *from) {
+    u64 pending = spill_pending(sp);
+    size_t room = 0;
+    size_t done = 0;
+    int err = 0;
+
+    if (sp->staged_bytes < SPILL_STAGE_MAX && pending < sp->limit) {
+        room = min_t(u64, SPILL_STAGE_MAX - sp->staged_bytes, sp->limit - pending);
+    }
+
+    while (room > 0 && iov_iter_count(from) > 0) {
+        struct spill_chunk *chunk = list_last_entry_or_null(&sp->staged, struct spill_chunk, node);
+        size_t len, copied;
+
+        if (chunk == NULL || chunk->busy || chunk->len == SPILL_CHUNK_DATA) {
+            chunk = kmalloc(PAGE_SIZE, GFP_KERNEL);
+            if (chunk == NULL) {
+                err = -ENOMEM;
+                break;
+            }
+            chunk->len = 0;
+            chunk->busy = false;
+            list_add_tail(&chunk->node, &sp->staged);
+        }
+
+        len = min3(iov_iter_count(from), room, SPILL_CHUNK_DATA - chunk->len);
+        copied = copy_from_iter(chunk->data + chunk->len, len, from);
+        chunk->len += copied;
+        WRITE_ONCE(sp->staged_bytes, sp->staged_bytes + copied);
+        room -= copied;
+        done += copied;
+        if (copied < len) {
+            err = -EFAULT;
+            break;
+        }
+    }
+
+    if (done > 0) {
+        sp->spilled_bytes += done;
+        queue_work(sp->wq, &sp->work);
+        return done;
+    }
+    return err;
+}
+
+// Read the oldest spilled data back from the file. Returns the number of
+// bytes copied, 0 if another reader got there first, or a negative error.
+static inline ssize_t spill_buffer_get(spill_buffer_t *sp, struct iov_iter *to) {
+    circular_buffer_t *cb = sp->cb;
+    size_t copied = 0;
+    loff_t pos;
+    size_t avail;
+    ssize_t ret;
+
+    mutex_lock(&sp->read_lock);
+    mutex_lock(&cb->lock);
+    pos = sp->read_pos;
+    avail = sp->write_pos - pos;
+    ret = sp->error;
+    mutex_unlock(&cb->lock);
+
+    if (avail == 0) {
+        mutex_unlock(&sp->read_lock);
+        return ret;
+    }
+
+    // The worker only appends past write_pos, so this range is stable
+    ret = kernel_read(sp->filp, sp->bounce, min3(iov_iter_count(to), avail, PAGE_SIZE), &pos);
+    if (ret > 0) {
+        copied = copy_to_iter(sp->bounce, ret, to);
+        ret = copied ? copied : -EFAULT;
+    } else if (ret == 0) {
+        ret = -EIO; // The file is shorter than what was written to it
+    }
+
+    mutex_lock(&cb->lock);
+    WRITE_ONCE(sp->read_pos, sp->read_pos + copied);
+    sp->unspilled_bytes += copied;
+    // Fully drained: start over at the beginning of the file
+    if (spill_pending(sp) == 0) {
+        WRITE_ONCE(sp->read_pos, 0);
+        WRITE_ONCE(sp->write_pos, 0);
+    }
+    mutex_unlock(&cb->lock);
+    mutex_unlock(&sp->read_lock);
+
+    return ret;
+}
+
+// Store all of from. Goes to the ring while nothing is spilled and the ring
+// has room, otherwise to the spill; only sleeps when the spill is at its limit.
+static inline ssize_t spill_buffer_write(spill_buffer_t *sp, struct iov_iter *from,
+                                         struct circ_wait_info *info) {
+    circular_buffer_t *cb = sp->cb;
+    size_t written = 0;
+    ssize_t copied;
+
+    while (iov_iter_count(from) > 0) {
+        if (circ_wait_event(cb->write_queue, spill_has_room(sp), info)) {
+            return written ? written : -ERESTARTSYS;
+        }
+
+        mutex_lock(&cb->lock);
+        if (sp->error) {
+            copied = sp->error;
+        } else if (spill_pending(sp) == 0 && cb->count < BUFFER_SIZE) {
+            copied = circular_buffer_put(cb, from);
+        } else {
+            copied = spill_buffer_put(sp, from);
+        }
+        mutex_unlock(&cb->lock);
+
+        if (copied < 0) {
+            return written ? written : copied;
+        }
+        written += copied;
+
+        wake_up_interruptible(&cb->read_queue);
+    }
+
+    return written;
+}
+
+// Fill all of to: first from the ring, which holds the oldest data, then
+// from the file, sleeping while both are empty
+static inline ssize_t spill_buffer_read(spill_buffer_t *sp, struct iov_iter *to,
+                                        struct circ_wait_info *info) {
+    circular_buffer_t *cb = sp->cb;
+    size_t read = 0;
+    ssize_t copied;
+
+    while (iov_iter_count(to) > 0) {
+        if (circ_wait_event(cb->read_queue, READ_ONCE(cb->count) > 0 || spill_readable(sp), info)) {
+            return read ? read : -ERESTARTSYS;
+        }
+
+        mutex_lock(&cb->lock);
+        if (cb->count > 0) {
+            copied = circular_buffer_get(cb, to);
+            mutex_unlock(&cb->lock);
+        } else {
+            mutex_unlock(&cb->lock);
+            copied = spill_buffer_get(sp, to);
+        }
+
+        if (copied < 0) {
+            return read ? read : copied;
+        }
+        read += copied;
+
+        wake_up_interruptible(&cb->write_queue);
+    }
+
+    return read;
+}
+
+#endif
@@ -10,6 +10,12 @@
 #include <linux/bio.h>
 #include <linux/highmem.h>
 #include <linux/spinlock.h>
+#include <linux/xarray.h>
+#include <linux/shrinker.h>
+#include <linux/moduleparam.h>
+#include <linux/sysfs.h>
+
+#include "srd_store.h"
 
 // --- Configuration ---
 #define SRD_DEVICE_NAME "simple_ramdisk"
@@ -22,17 +28,14 @@ MODULE_LICENSE("GPL");
 MODULE_AUTHOR("BiscuitBobby");
 MODULE_DESCRIPTION("Simple RAM Disk Block Driver");
 
+// Let a shrinker release backing pages that partial writes have left all-zero
+static bool reclaim_zero_pages = true;
+module_param(reclaim_zero_pages, bool, 0444);
+MODULE_PARM_DESC(reclaim_zero_pages, "Release all-zero pages under memory pressure (default: true)");
+
 // Forward declaration for submit_bio
 static void srd_submit_bio(struct bio *bio);
 
-// Device specific structure
-struct simple_ramdisk {
-    struct gendisk *gd;        // The generic disk structure
-    unsigned char *data;       // Pointer to the allocated RAM buffer
-    size_t size;               // Size of the RAM buffer in bytes
-    spinlock_t lock;           // Lock to protect buffer access
-};
-
 // Global storage for our single device instance and major number
 static struct simple_ramdisk *srd_dev;
 static int srd_major;
@@ -46,6 +49,84 @@ static const struct block_device_operations srd_ops = {
     .submit_bio = srd_submit_bio, // Main I/O handler
 };
 
+// --- Memory Pressure ---
+
+static unsigned long srd_shrink_count(struct shrinker *shrink, struct shrink_control *sc)
+{
+    struct simple_ramdisk *dev = shrink->private_data;
+    unsigned long nr = READ_ONCE(dev->nr_zero);
+
+    return nr ? nr : SHRINK_EMPTY;
+}
+
+// Verify tagged pages and release the ones that really are all zeroes.
+// Pages holding data are never dropped: RAM is their only copy.
+static unsigned long srd_shrink_scan(struct shrinker *shrink, struct shrink_control *sc)
+{
+    struct simple_ramdisk *dev = shrink->private_data;
+    unsigned long scanned = 0, freed = 0;
+    unsigned long idx;
+    struct page *page;
+    void *ram_addr;
+    bool zero;
+
+    spin_lock(&dev->lock);
+    xa_for_each_marked(&dev->pages, idx, page, SRD_MARK_ZERO) {
+        if (scanned >= sc->nr_to_scan)
+            break;
+        scanned++;
+
+        ram_addr = kmap_local_page(page);
+        zero = !memchr_inv(ram_addr, 0, PAGE_SIZE);
+        kunmap_local(ram_addr);
+
+        if (zero) {
+            srd_free_page(dev, idx);
+            freed++;
+        } else {
+            srd_set_zero_mark(dev, idx, false);
+        }
+    }
+    spin_unlock(&dev->lock);
+
+    sc->nr_scanned = scanned;
+    return scanned ? freed : SHRINK_STOP;
+}
+
+// --- Sysfs Attributes (/sys/block/srd0/srd/) ---
+
+static ssize_t mem_used_show(struct device *d, struct device_attribute *attr, char *buf)
+{
+    struct simple_ramdisk *dev = dev_to_disk(d)->private_data;
+
+    return sysfs_emit(buf, "%lu\n", READ_ONCE(dev->nr_pages) << PAGE_SHIFT);
+}
+static DEVICE_ATTR_RO(mem_used);
+
+static ssize_t mem_reclaimable_show(struct device *d, struct device_attribute *attr, char *buf)
+{
+    struct simple_ramdisk *dev = dev_to_disk(d)->private_data;
+
+    return sysfs_emit(buf, "%lu\n", READ_ONCE(dev->nr_zero) << PAGE_SHIFT);
+}
+static DEVICE_ATTR_RO(mem_reclaimable);
+
+static struct attribute *srd_attrs[] = {
+    &dev_attr_mem_used.attr,
+    &dev_attr_mem_reclaimable.attr,
+    NULL,
+};
+
+static const struct attribute_group srd_attr_group = {
+    .name = "srd",
+    .attrs = srd_attrs,
+};
+
+static const struct attribute_group *srd_attr_groups[] = {
+    &srd_attr_group,
+    NULL,
+};
+
 // --- I/O Handling ---
 static void srd_handle_bio(struct simple_ramdisk *dev, struct bio *bio)
 {
@@ -74,20 +155,10 @@ static void srd_handle_bio(struct simple_ramdisk *dev, struct bio *bio)
             return;
         }
 
-        // Check bounds for the entire operation
-        if (dev_offset + total_len_to_process > dev->size) {
-            pr_err("%s: DISCARD/ZERO Access beyond end of device (sector %llu, offset %zu, len %zu > size %zu)\n",
-                   SRD_DEVICE_NAME, (unsigned long long)sector_off, dev_offset, total_len_to_process, dev->size);
-            bio->bi_status = BLK_STS_IOERR;
-            return;
-        }
-
-        spin_lock(&dev->lock);
-        memset(dev->data + dev_offset, 0, total_len_to_process);
-        spin_unlock(&dev->lock);
+        // Bounds are checked for the entire operation
+        bio->bi_status = srd_do_io(dev, bio_op(bio), NULL, dev_offset, total_len_to_process);
 
-        printk(KERN_DEBUG "%s: Discard/Zero %zu bytes at offset %zu\n", SRD_DEVICE_NAME, total_len_to_process, dev_offset);
-        bio->bi_status = BLK_STS_OK;
+        pr_debug("%s: Discard/Zero %zu bytes at offset %zu\n", SRD_DEVICE_NAME, total_len_to_process, dev_offset);
         return; // Handled, no need to iterate bio_vecs
     }
 
@@ -104,7 +175,6 @@ static void srd_handle_bio(struct simple_ramdisk *dev, struct bio *bio)
     do {
         struct bio_vec bvec = bio_iter_iovec(bio, iter); // Should be safe now for R/W
         size_t len = bvec.bv_len;
-        unsigned char *ram_addr;
         unsigned char *bio_addr = NULL;
 
         if (len == 0) { // Skip zero-length segments
@@ -112,15 +182,6 @@ static void srd_handle_bio(struct simple_ramdisk *dev, struct bio *bio)
             continue;
         }
 
-        if (dev_offset + len > dev->size) {
-            pr_err("%s: Access beyond end of device (sector %llu, offset %zu, len %zu > size %zu)\n",
-                   SRD_DEVICE_NAME, (unsigned long long)sector_off, dev_offset, len, dev->size);
-            bio->bi_status = BLK_STS_IOERR;
-            break;
-        }
-
-        ram_addr = dev->data + dev_offset;
-
         // bio_op should only be READ or WRITE here due to earlier check
         if (!bvec.bv_page) {
             pr_err("%s: NULL page in BIO for Read/Write op at sector %llu\n",
@@ -130,23 +191,8 @@ static void srd_handle_bio(struct simple_ramdisk *dev, struct bio *bio)
         }
         bio_addr = kmap_local_page(bvec.bv_page) + bvec.bv_offset;
 
-        spin_lock(&dev->lock);
-        switch (bio_op(bio)) { // Should only be READ or WRITE
-            case REQ_OP_READ:
-                memcpy(bio_addr, ram_addr, len);
-                printk(KERN_DEBUG "%s: Read %zu bytes at offset %zu\n", SRD_DEVICE_NAME, len, dev_offset);
-                break;
-            case REQ_OP_WRITE:
-                memcpy(ram_addr, bio_addr, len);
-                printk(KERN_DEBUG "%s: Write %zu bytes at offset %zu\n", SRD_DEVICE_NAME, len, dev_offset);
-                break;
-            default:
-                // This case should ideally not be reached if the logic above is correct
-                pr_warn("%s: Unexpected BIO operation in R/W loop: %d\n", SRD_DEVICE_NAME, bio_op(bio));
-                bio->bi_status = BLK_STS_IOERR;
-                break;
-        }
-        spin_unlock(&dev->lock);
+        // bio_op should only be READ or WRITE here; bounds are checked per segment
+        bio->bi_status = srd_do_io(dev, bio_op(bio), bio_addr, dev_offset, len);
 
         if (bio_addr) {
             kunmap_local(bio_addr);
@@ -156,6 +202,9 @@ static void srd_handle_bio(struct simple_ramdisk *dev, struct bio *bio)
              break;
         }
 
+        pr_debug("%s: %s %zu bytes at offset %zu\n", SRD_DEVICE_NAME,
+                 op_is_write(bio_op(bio)) ? "Write" : "Read", len, dev_offset);
+
         dev_offset += len;
         bio_advance_iter_single(bio, &iter, len);
 
@@ -191,17 +240,22 @@ static int create_simple_ramdisk(struct simple_ramdisk **dev_ptr)
         return -ENOMEM;
     }
     memset(dev, 0, sizeof(*dev));
-    spin_lock_init(&dev->lock);
-
-    // 2. Allocate the RAM buffer (using vmalloc for potentially large sizes)
-    dev->size = (size_t)SRD_CAPACITY_MB * 1024 * 1024;
-    dev->data = vzalloc(dev->size); // vzalloc zeros the memory
-    if (!dev->data) {
-        printk("%s: Failed to allocate RAM buffer (%zu bytes)\n", SRD_DEVICE_NAME, dev->size);
-        kfree(dev);
-        return -ENOMEM;
+
+    // 2. Set up the sparse page store; pages are only allocated when written
+    srd_init_store(dev, (size_t)SRD_CAPACITY_MB * 1024 * 1024, reclaim_zero_pages);
+    pr_info("%s: Sparse RAM buffer of up to %d MiB\n", SRD_DEVICE_NAME, SRD_CAPACITY_MB);
+
+    if (reclaim_zero_pages) {
+        dev->shrinker = shrinker_alloc(0, "%s-zero", SRD_DEVICE_NAME);
+        if (!dev->shrinker) {
+            printk("%s: Failed to allocate shrinker\n", SRD_DEVICE_NAME);
+            kfree(dev);
+            return -ENOMEM;
+        }
+        dev->shrinker->count_objects = srd_shrink_count;
+        dev->shrinker->scan_objects = srd_shrink_scan;
+        dev->shrinker->private_data = dev;
     }
-    pr_info("%s: Allocated RAM buffer of %d MiB\n", SRD_DEVICE_NAME, SRD_CAPACITY_MB);
 
     // 3. Configure Queue Limits
     //    Physical block size often matches logical for simple RAM disks
@@ -213,6 +267,7 @@ static int create_simple_ramdisk(struct simple_ramdisk **dev_ptr)
         .max_sectors            = UINT_MAX, // No real hardware limit
         .max_hw_discard_sectors = UINT_MAX, // Can discard everything
         .max_write_zeroes_sectors = UINT_MAX, // Can write zeroes to everything
+        .discard_granularity    = PAGE_SIZE, // Backing memory is freed per page
     };
 
 
@@ -238,13 +293,17 @@ static int create_simple_ramdisk(struct simple_ramdisk **dev_ptr)
     pr_info("%s: Disk capacity set to %llu sectors (%d MiB)\n",
            SRD_DEVICE_NAME, (unsigned long long)SRD_SECTORS, SRD_CAPACITY_MB);
 
-    // 7. Add Gendisk to System
-    ret = add_disk(dev->gd);
+    // 7. Add Gendisk to System, along with our memory usage attributes
+    ret = device_add_disk(NULL, dev->gd, srd_attr_groups);
     if (ret) {
         printk("%s: Failed to add disk: %d\n", SRD_DEVICE_NAME, ret);
         goto cleanup_disk_obj;
     }
 
+    // 8. Start answering memory pressure once I/O can populate pages
+    if (dev->shrinker)
+        shrinker_register(dev->shrinker);
+
     pr_info("%s: Disk '%s' added successfully\n", SRD_DEVICE_NAME, dev->gd->disk_name);
     *dev_ptr = dev; // Return the successfully created device
     return 0; // Success
@@ -253,7 +312,8 @@ static int create_simple_ramdisk(struct simple_ramdisk **dev_ptr)
 cleanup_disk_obj:
     put_disk(dev->gd); // Release gendisk resources (including queue)
 cleanup_buffer:
-    vfree(dev->data);
+    shrinker_free(dev->shrinker); // Never registered, NULL-safe
+    srd_free_pages(dev);
     kfree(dev);
     *dev_ptr = NULL;
     return ret;
@@ -268,9 +328,8 @@ static void delete_simple_ramdisk(struct simple_ramdisk *dev)
         del_gendisk(dev->gd); // Remove from system first
         put_disk(dev->gd);    // Then release resources
     }
-    if (dev->data) {
-        vfree(dev->data);     // Free the RAM buffer
-    }
+    shrinker_free(dev->shrinker); // Unregisters and waits for running scans
+    srd_free_pages(dev);          // Free the backing pages
     kfree(dev);               // Free the device structure
     pr_info("%s: Device resources released\n", SRD_DEVICE_NAME);
 }
@@ -0,0 +1,251 @@
+#ifndef SRD_STORE_H
+#define SRD_STORE_H
+
+#include <linux/kernel.h>
+#include <linux/blk_types.h>
+#include <linux/gfp.h>
+#include <linux/highmem.h>
+#include <linux/spinlock.h>
+#include <linux/xarray.h>
+
+// Page store and I/O core of the simple_block ramdisk, kept free of gendisk
+// and bio handling so bench/kmicro can drive it directly.
+
+// Backing pages that partial writes or discards have left all-zero are
+// tagged with this mark; whole-page zero writes free the page right away
+#define SRD_MARK_ZERO XA_MARK_0
+
+struct gendisk;
+struct shrinker;
+
+// Device specific structure
+// Backing memory is allocated one page at a time on first write. A page that
+// is absent from the xarray reads back as zeroes, so discarded ranges simply
+// drop their pages and RAM usage follows the amount of live data.
+struct simple_ramdisk {
+    struct gendisk *gd;        // The generic disk structure
+    struct xarray pages;       // Backing pages, indexed by device page number
+    size_t size;               // Size of the device in bytes
+    unsigned long nr_pages;    // Backing pages currently allocated
+    unsigned long nr_zero;     // Pages tagged SRD_MARK_ZERO (reclaim candidates)
+    bool track_zero;           // Tag pages that have become all-zero
+    struct shrinker *shrinker; // Releases all-zero pages under memory pressure
+    spinlock_t lock;           // Lock to protect buffer access
+};
+
+// --- Backing Page Management ---
+
+// Track whether a page is now all zeroes. Callers only pass zero = true after
+// checking the whole page. Caller holds dev->lock.
+static inline void srd_set_zero_mark(struct simple_ramdisk *dev, pgoff_t idx, bool zero)
+{
+    bool marked;
+
+    if (!dev->track_zero)
+        return;
+
+    marked = xa_get_mark(&dev->pages, idx, SRD_MARK_ZERO);
+    if (zero && !marked) {
+        xa_set_mark(&dev->pages, idx, SRD_MARK_ZERO);
+        dev->nr_zero++;
+    } else if (!zero && marked) {
+        xa_clear_mark(&dev->pages, idx, SRD_MARK_ZERO);
+        dev->nr_zero--;
+    }
+}
+
+// Release the backing page at idx, if any. Caller holds dev->lock.
+static inline void srd_free_page(struct simple_ramdisk *dev, pgoff_t idx)
+{
+    struct page *page;
+
+    srd_set_zero_mark(dev, idx, false);
+    page = xa_erase(&dev->pages, idx);
+    if (page) {
+        __free_page(page);
+        dev->nr_pages--;
+    }
+}
+
+// Copy len bytes (not crossing a page boundary) from src into the device at
+// dev_offset, allocating the backing page on first write. A whole page of
+// zeroes releases the backing page instead.
+static inline int srd_write_chunk(struct simple_ramdisk *dev, const void *src,
+                                  size_t dev_offset, size_t len)
+{
+    pgoff_t idx = dev_offset >> PAGE_SHIFT;
+    unsigned int pg_off = offset_in_page(dev_offset);
+    bool zero = !memchr_inv(src, 0, len);
+    struct page *page, *new_page = NULL;
+    void *ram_addr;
+
+    spin_lock(&dev->lock);
+    page = xa_load(&dev->pages, idx);
+    if (!page) {
+        // A missing page already reads back as zeroes
+        if (zero) {
+            spin_unlock(&dev->lock);
+            return 0;
+        }
+        spin_unlock(&dev->lock);
+
+        // Allocate the page and its xarray slot where we are allowed to sleep
+        new_page = alloc_page(GFP_NOIO | __GFP_ZERO | __GFP_HIGHMEM);
+        if (!new_page)
+            return -ENOMEM;
+        if (xa_reserve(&dev->pages, idx, GFP_NOIO)) {
+            __free_page(new_page);
+            return -ENOMEM;
+        }
+
+        spin_lock(&dev->lock);
+        page = xa_load(&dev->pages, idx);
+        if (!page) {
+            // The slot is reserved, so this store does not allocate
+            xa_store(&dev->pages, idx, new_page, GFP_ATOMIC);
+            page = new_page;
+            new_page = NULL;
+            dev->nr_pages++;
+        } else {
+            xa_release(&dev->pages, idx); // Lost the race, use the winner's page
+        }
+    } else if (zero && len == PAGE_SIZE) {
+        srd_free_page(dev, idx);
+        spin_unlock(&dev->lock);
+        return 0;
+    }
+
+    ram_addr = kmap_local_page(page);
+    memcpy(ram_addr + pg_off, src, len);
+    // Zeroing part of a page only makes it a candidate if the rest is zero too
+    if (zero && dev->track_zero)
+        zero = !memchr_inv(ram_addr, 0, PAGE_SIZE);
+    kunmap_local(ram_addr);
+    srd_set_zero_mark(dev, idx, zero);
+    spin_unlock(&dev->lock);
+
+    if (new_page)
+        __free_page(new_page);
+    return 0;
+}
+
+// Copy len bytes (not crossing a page boundary) from the device into dst
+static inline void srd_read_chunk(struct simple_ramdisk *dev, void *dst,
+                                  size_t dev_offset, size_t len)
+{
+    unsigned int pg_off = offset_in_page(dev_offset);
+    struct page *page;
+    void *ram_addr;
+
+    spin_lock(&dev->lock);
+    page = xa_load(&dev->pages, dev_offset >> PAGE_SHIFT);
+    if (page) {
+        ram_addr = kmap_local_page(page);
+        memcpy(dst, ram_addr + pg_off, len);
+        kunmap_local(ram_addr);
+    } else {
+        memset(dst, 0, len);
+    }
+    spin_unlock(&dev->lock);
+}
+
+// Zero a byte range: whole pages are released, partial pages are cleared in place
+static inline void srd_discard_range(struct simple_ramdisk *dev, size_t dev_offset, size_t len)
+{
+    spin_lock(&dev->lock);
+    while (len > 0) {
+        pgoff_t idx = dev_offset >> PAGE_SHIFT;
+        unsigned int pg_off = offset_in_page(dev_offset);
+        size_t chunk = min_t(size_t, len, PAGE_SIZE - pg_off);
+        struct page *page;
+        void *ram_addr;
+
+        if (chunk == PAGE_SIZE) {
+            srd_free_page(dev, idx);
+        } else {
+            page = xa_load(&dev->pages, idx);
+            if (page) {
+                memzero_page(page, pg_off, chunk);
+                if (dev->track_zero) {
+                    ram_addr = kmap_local_page(page);
+                    srd_set_zero_mark(dev, idx, !memchr_inv(ram_addr, 0, PAGE_SIZE));
+                    kunmap_local(ram_addr);
+                }
+            }
+        }
+
+        dev_offset += chunk;
+        len -= chunk;
+    }
+    spin_unlock(&dev->lock);
+}
+
+// Release every backing page (device teardown)
+static inline void srd_free_pages(struct simple_ramdisk *dev)
+{
+    struct page *page;
+    unsigned long idx;
+
+    xa_for_each(&dev->pages, idx, page) {
+        __free_page(page);
+    }
+    xa_destroy(&dev->pages);
+    dev->nr_pages = 0;
+    dev->nr_zero = 0;
+}
+
+// Prepare an empty store of size bytes
+static inline void srd_init_store(struct simple_ramdisk *dev, size_t size, bool track_zero)
+{
+    spin_lock_init(&dev->lock);
+    xa_init(&dev->pages);
+    dev->size = size;
+    dev->track_zero = track_zero;
+}
+
+// Perform one operation on a byte range of the device. buf is the source for
+// REQ_OP_WRITE and the destination for REQ_OP_READ; it is unused for
+// REQ_OP_DISCARD and REQ_OP_WRITE_ZEROES.
+static inline blk_status_t srd_do_io(struct simple_ramdisk *dev, enum req_op op, void *buf,
+                                     size_t dev_offset, size_t len)
+{
+    size_t done = 0;
+
+    if (dev_offset > dev->size || len > dev->size - dev_offset) {
+        pr_err("simple_ramdisk: Access beyond end of device (offset %zu, len %zu > size %zu)\n",
+               dev_offset, len, dev->size);
+        return BLK_STS_IOERR;
+    }
+
+    if (op == REQ_OP_DISCARD || op == REQ_OP_WRITE_ZEROES) {
+        // Whole pages go back to the page allocator instead of being memset
+        srd_discard_range(dev, dev_offset, len);
+        return BLK_STS_OK;
+    }
+
+    // A range may straddle backing pages, so copy page by page
+    while (done < len) {
+        size_t off = dev_offset + done;
+        size_t chunk = min_t(size_t, len - done, PAGE_SIZE - offset_in_page(off));
+
+        switch (op) {
+            case REQ_OP_READ:
+                srd_read_chunk(dev, buf + done, off, chunk);
+                break;
+            case REQ_OP_WRITE:
+                if (srd_write_chunk(dev, buf + done, off, chunk)) {
+                    pr_err("simple_ramdisk: Failed to allocate backing page at offset %zu\n", off);
+                    return BLK_STS_RESOURCE;
+                }
+                break;
+            default:
+                pr_warn("simple_ramdisk: Unexpected operation: %d\n", op);
+                return BLK_STS_NOTSUPP;
+        }
+        done += chunk;
+    }
+
+    return BLK_STS_OK;
+}
+
+#endif
@@ -5,6 +5,19 @@
 #include <linux/types.h> //dev_t
 #include <linux/uaccess.h> //access userspace
 #include <linux/moduleparam.h> //access userspace
+#include <linux/mutex.h>
+#include <linux/uio.h> //iov_iter
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/slab.h>
+#include <linux/poll.h>
+#include <linux/wait.h>
+
+#include "char_simp.h"
+#include "../common/drv_stats.h"
+
+#define CREATE_TRACE_POINTS
+#include "char_simp_trace.h"
 
 #define DEVICE_NAME "char_simp_dev"
 
@@ -15,65 +28,200 @@ MODULE_DESCRIPTION("Simple character driver");
 static int major_num;
 static struct cdev le_cdev;
 static int size = 255;
-char *charArray;
-static int buffer_ptr = 0;
+static struct char_simp_header *header; // Start of the mmap()able region
+char *charArray;                        // Data buffer, one page after header
+static int buffer_ptr = 0; // Number of valid bytes in charArray
+static DEFINE_MUTEX(buffer_lock); // Serializes access to charArray and buffer_ptr
+
+static bool wait_for_change = false;
+static DECLARE_WAIT_QUEUE_HEAD(change_wait); // Woken after every completed write
+static struct drv_stats __percpu *stats; // Exposed in /sys/kernel/debug/char_simp_dev/stats
+static struct dentry *debug_dir;
+
+module_param(size, int, 0444);
+module_param(wait_for_change, bool, 0644);
+MODULE_PARM_DESC(wait_for_change, "A read at offset 0 blocks until the contents change (default: false)");
+
+// Per-open state, kept in file->private_data
+struct reader_state {
+    u64 seen_gen; // Generation observed by this file's last read
+};
+
+// Generation of the last completed write (an in-progress write makes it odd)
+static u64 completed_generation(void) {
+    return smp_load_acquire(&header->generation) & ~1ULL;
+}
+
+static bool changed_since_read(struct reader_state *rs) {
+    return completed_generation() != READ_ONCE(rs->seen_gen);
+}
 
-module_param(size, int, 0644);
+// Mark the buffer as being modified for readers polling the mapped header.
+// Caller holds buffer_lock.
+static void begin_update(void) {
+    WRITE_ONCE(header->generation, header->generation + 1);
+    smp_wmb();
+}
+
+static void end_update(void) {
+    WRITE_ONCE(header->used, buffer_ptr);
+    smp_store_release(&header->generation, header->generation + 1);
+    wake_up_interruptible_poll(&change_wait, EPOLLIN | EPOLLRDNORM);
+}
 
 static int simple_char_open(struct inode *inode, struct file *instance) {
-    printk(KERN_INFO "char_simp_dev: opened device\n");
+    struct reader_state *rs = kzalloc(sizeof(struct reader_state), GFP_KERNEL);
+
+    if (rs == NULL) {
+        return -ENOMEM;
+    }
+    // Odd, so it never matches a completed generation: the existing contents,
+    // including the initial ones from before any write, are new to a fresh reader
+    rs->seen_gen = U64_MAX;
+    instance->private_data = rs;
+    // Keep the old "each write session replaces the contents" behaviour for
+    // shell redirects such as `echo foo > /dev/char_simp_dev`
+    if ((instance->f_mode & FMODE_WRITE) && (instance->f_flags & O_TRUNC)) {
+        mutex_lock(&buffer_lock);
+        begin_update();
+        buffer_ptr = 0;
+        end_update();
+        mutex_unlock(&buffer_lock);
+    }
+    this_cpu_inc(stats->opens);
+    trace_char_simp_open(instance->f_flags);
     return 0;
 }
 
-ssize_t dev_read(struct file *FILE, char *user_buffer, size_t count, loff_t *offset) {
-    int to_cpy, not_cpy, delta;
+// Each open file keeps its own position in f_pos, so pread/pwrite/readv/writev
+// and concurrent readers work without disturbing one another.
+static loff_t dev_llseek(struct file *file, loff_t offset, int whence) {
+    return generic_file_llseek_size(file, offset, whence, size, READ_ONCE(buffer_ptr));
+}
 
-    to_cpy = min_t(int, count, buffer_ptr - *offset);
-    not_cpy = copy_to_user(user_buffer, charArray + *offset, to_cpy);
+static ssize_t do_read(struct kiocb *iocb, struct iov_iter *to, u64 *blocked_ns) {
+    struct reader_state *rs = iocb->ki_filp->private_data;
+    loff_t pos = iocb->ki_pos;
+    size_t to_cpy, copied;
 
-    if (not_cpy != 0) {
-        return -EFAULT;
+    // Replaces busy-polling: a read from the start waits for the next write
+    if (wait_for_change && pos == 0 && !changed_since_read(rs)) {
+        u64 start;
+        int interrupted;
+
+        if (iocb->ki_filp->f_flags & O_NONBLOCK) {
+            return -EAGAIN;
+        }
+        start = ktime_get_ns();
+        interrupted = wait_event_interruptible(change_wait, changed_since_read(rs));
+        this_cpu_inc(stats->blocked_waits);
+        *blocked_ns = ktime_get_ns() - start;
+        if (interrupted) {
+            return -ERESTARTSYS;
+        }
     }
 
-    delta = to_cpy - not_cpy;
+    mutex_lock(&buffer_lock);
+    WRITE_ONCE(rs->seen_gen, header->generation); // Even: writers hold buffer_lock
+    if (pos >= buffer_ptr) {
+        mutex_unlock(&buffer_lock);
+        return 0;
+    }
 
-    *offset += delta;
-    printk(KERN_INFO "char_simp_dev: read %d bytes\n", delta);
+    to_cpy = min_t(size_t, iov_iter_count(to), buffer_ptr - pos);
+    copied = copy_to_iter(charArray + pos, to_cpy, to);
+    mutex_unlock(&buffer_lock);
 
-    return delta;
+    if (copied == 0 && to_cpy != 0) {
+        return -EFAULT;
+    }
+
+    iocb->ki_pos = pos + copied;
+    return copied;
 }
 
-ssize_t dev_write (struct file *File, const char *user_buffer, size_t count, loff_t *offset){
-    buffer_ptr = 0;
-    int to_cpy, not_cpy, delta;
+static ssize_t do_write(struct kiocb *iocb, struct iov_iter *from) {
+    loff_t pos;
+    size_t to_cpy, copied;
 
-    to_cpy = min_t(int, count, size - buffer_ptr);
-    printk(KERN_INFO "char_simp_dev: count: %d length of charArray: %d buffer_ptr: %d bytes to copy: %d", count, size, buffer_ptr, to_cpy);
+    mutex_lock(&buffer_lock);
+    // O_APPEND writes always land at the current end of data
+    pos = (iocb->ki_flags & IOCB_APPEND) ? buffer_ptr : iocb->ki_pos;
+    if (pos >= size) {
+        mutex_unlock(&buffer_lock);
+        return iov_iter_count(from) ? -ENOSPC : 0;
+    }
 
-    not_cpy = copy_from_user(charArray + buffer_ptr, user_buffer, to_cpy);
-    
-    if (not_cpy != 0) {
+    to_cpy = min_t(size_t, iov_iter_count(from), size - pos);
+
+    begin_update();
+    copied = copy_from_iter(charArray + pos, to_cpy, from);
+    if (pos + copied > buffer_ptr) {
+        buffer_ptr = pos + copied;
+    }
+    end_update();
+    mutex_unlock(&buffer_lock);
+
+    if (copied == 0 && to_cpy != 0) {
         return -EFAULT;
     }
 
-    buffer_ptr += to_cpy;
-    delta = to_cpy - not_cpy;
+    iocb->ki_pos = pos + copied;
+    return copied;
+}
 
-    printk(KERN_INFO "char_simp_dev: written ");
-    
-    /*for (int i = 0; i<buffer_ptr; i++) {  //for debugging
-        printk(KERN_INFO "%c", charArray[i]);
-    };*/
-    
-    printk(KERN_INFO "char_simp_dev: written %d bytes\n", to_cpy);
-    return delta;
+static ssize_t dev_read_iter(struct kiocb *iocb, struct iov_iter *to) {
+    size_t requested = iov_iter_count(to);
+    u64 start = trace_char_simp_io_enabled() ? ktime_get_ns() : 0;
+    u64 blocked_ns = 0;
+    ssize_t result = do_read(iocb, to, &blocked_ns);
+
+    drv_stats_io(stats, false, result);
+    trace_char_simp_io(false, requested, result, start ? ktime_get_ns() - start : 0, blocked_ns);
+    return result;
+}
+
+static ssize_t dev_write_iter(struct kiocb *iocb, struct iov_iter *from) {
+    size_t requested = iov_iter_count(from);
+    u64 start = trace_char_simp_io_enabled() ? ktime_get_ns() : 0;
+    ssize_t result = do_write(iocb, from);
+
+    drv_stats_io(stats, true, result);
+    trace_char_simp_io(true, requested, result, start ? ktime_get_ns() - start : 0, 0);
+    return result;
+}
+
+// Readable once a write has completed since this file last read the device
+static __poll_t dev_poll(struct file *file, poll_table *wait) {
+    __poll_t mask = EPOLLOUT | EPOLLWRNORM;
+
+    poll_wait(file, &change_wait, wait);
+    if (changed_since_read(file->private_data)) {
+        mask |= EPOLLIN | EPOLLRDNORM;
+    }
+    return mask;
+}
+
+// Map the header page and data buffer straight into the caller. The header
+// page is only ever mapped read-only so the generation cannot be forged.
+static int dev_mmap(struct file *file, struct vm_area_struct *vma) {
+    if (vma->vm_pgoff == 0) {
+        if (vma->vm_flags & VM_WRITE) {
+            return -EPERM;
+        }
+        vm_flags_clear(vma, VM_MAYWRITE);
+    }
+
+    // Fails with -EINVAL if the range runs past the end of the buffer
+    return remap_vmalloc_range(vma, header, vma->vm_pgoff);
 }
 
 static int simple_char_release(struct inode *inode, struct file *instance) {
     /*for (int i = 0; i<buffer_ptr; i++) {  //for debugging
         printk(KERN_INFO "%c", charArray[i]);
     };*/
-    printk(KERN_INFO "char_simp_dev: driver closed\n");
+    kfree(instance->private_data);
+    trace_char_simp_release(instance->f_flags);
     return 0;
 }
 
@@ -81,8 +229,11 @@ static const struct file_operations fops = {
     .owner = THIS_MODULE,
     .open = simple_char_open,
     .release = simple_char_release,
-    .read = dev_read,
-    .write = dev_write,
+    .llseek = dev_llseek,
+    .read_iter = dev_read_iter,
+    .write_iter = dev_write_iter,
+    .mmap = dev_mmap,
+    .poll = dev_poll,
 };
 
 static int __init simple_char_init(void) {
@@ -90,19 +241,34 @@ static int __init simple_char_init(void) {
     int regval;
 
     printk(KERN_INFO "char_simp_dev: Buffer size: %d\n", size);
-    charArray = kmalloc(size * sizeof(char), GFP_KERNEL);
-    if (charArray == NULL) {
+    if (size <= 0) {
+        return -EINVAL;
+    }
+
+    // Page-aligned and zeroed so it can be handed to userspace as is
+    header = vmalloc_user(PAGE_SIZE + PAGE_ALIGN(size));
+    if (header == NULL) {
         return -ENOMEM;
     }
+    header->size = size;
+    charArray = (char *)header + PAGE_SIZE;
 
     for (int i = 0; i<size; i++) {
         charArray[i]=' ';
     };
 
+    stats = alloc_percpu(struct drv_stats);
+    if (stats == NULL) {
+        vfree(header);
+        return -ENOMEM;
+    }
+
     regval = alloc_chrdev_region(&dev_num, 0, 1, DEVICE_NAME);
     
     if (regval < 0) {
         printk(KERN_ALERT "char_simp_dev: Memory allocation for major number failed\n");
+        free_percpu(stats);
+        vfree(header);
         return regval;
     }
 
@@ -114,13 +280,17 @@ static int __init simple_char_init(void) {
     
     if (regval < 0) {
         printk(KERN_ALERT "char_simp_dev: Failed to load device\n");
+        unregister_chrdev_region(dev_num, 1);
+        free_percpu(stats);
+        vfree(header);
         return regval;
     }
     
     else if (regval > 0) {
         printk(KERN_ALERT "returned value:%d\n", regval);
     }
-    
+
+    debug_dir = drv_stats_debugfs_create(DEVICE_NAME, stats);
     return 0;
 }
 
@@ -128,6 +298,9 @@ static void __exit simple_char_exit(void) {
     dev_t dev_num = MKDEV(major_num, 0);
     cdev_del(&le_cdev);
     unregister_chrdev_region(dev_num, 1);
+    debugfs_remove(debug_dir);
+    free_percpu(stats);
+    vfree(header);
     printk(KERN_INFO "char_simp: Exited\n");
 }
 
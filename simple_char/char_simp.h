@@ -0,0 +1,22 @@
+#ifndef CHAR_SIMP_H
+#define CHAR_SIMP_H
+
+#include <linux/types.h>
+
+// Layout of an mmap() of char_simp_dev. Page 0 of the mapping holds a
+// struct char_simp_header and the data buffer starts at page 1 (offset
+// sysconf(_SC_PAGESIZE)). Page 0 can only be mapped read-only; map from
+// page 1 onwards to get a writable view of the data.
+//
+// generation works like a seqcount: it is odd while a write() is copying
+// into the buffer and advances by two per completed write. A reader that
+// samples an even generation, reads the data and sees the same value again
+// got a consistent snapshot without a syscall. Stores made through a
+// writable mapping do not touch the generation.
+struct char_simp_header {
+    __u64 generation;
+    __u64 used;  // Number of valid bytes in the data buffer
+    __u64 size;  // Capacity of the data buffer
+};
+
+#endif